@@ -2,6 +2,8 @@
 #define CHAMPARNAUD_H_
 
 #include <vector>
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include "divisor.hpp"
 #include "mer_op.hpp"
@@ -175,20 +177,131 @@ struct index_t {
 		return std::make_pair(min_u, min_d);
 	}
 
-	bool in_champarnaud_set(const mer_t mer) const {
-		for(unsigned i = 0; i < m_k; ++i) {
-			// mer_t rev = i == 0 ? mer : subword(0, i, mer) + subword(i, m_k - i, mer) * alphap[i].d();
-			mer_t rev = i == 0 ? mer : subword(0, i, mer) + subword(i, m_k - i, mer) * alphap[i];
-			bool smallest = true;
-			for(mer_t cur = mer_ops::nmer(rev); cur != rev && smallest; cur = mer_ops::nmer(cur))
-				smallest = rev < cur;
-			if(!smallest)
+	// Length of l^n in the main division of w = l^n u (see parts), in linear
+	// time. The prefixes of w that are Lyndon words are found by the first
+	// phase of Duval's algorithm: w[0..j] is Lyndon when w[j] is strictly
+	// greater than the base it is compared to. The repetition of the prefix is
+	// checked with the Z-function of w.
+	unsigned lyndon_power_prefix(const unsigned k, const uint8_t* w) const {
+		assert2(k <= mer_ops::k, "k must be at most mer_ops::k");
+		unsigned z[mer_ops::k] = {}; // z[i] = longest common prefix of w and w[i:]
+		z[0] = k;
+		for(unsigned i = 1, l = 0, r = 0; i < k; ++i) {
+			z[i] = i < r ? std::min(r - i, z[i - l]) : 0;
+			while(i + z[i] < k && w[z[i]] == w[i + z[i]])
+				++z[i];
+			if(i + z[i] > r) {
+				l = i;
+				r = i + z[i];
+			}
+		}
+
+		auto is_power = [&](unsigned len) { return z[len] >= (k / len - 1) * len; };
+		if(k > 1 && is_power(1)) return k; // Homopolymer. Prefix of length 1 is Lyndon
+		for(unsigned i = 0, j = 1; j < k - 1 && w[i] <= w[j]; ++j) {
+			if(w[i] < w[j]) {
+				i = 0;
+				if(is_power(j + 1)) return (k / (j + 1)) * (j + 1);
+			} else {
+				++i;
+			}
+		}
+		return k;
+	}
+
+	// Is the word s (s[0] is the left base) in the set. Linear time: with N
+	// the necklace of s (its least rotation, found with the two pointers
+	// algorithm), s is in the set if and only if it is equal to reversed(N).
+	bool in_champarnaud_set(const uint8_t* s) const {
+		const unsigned k = m_k;
+		unsigned i = 0, j = 1, l = 0;
+		while(i < k && j < k && l < k) {
+			const auto a = s[(i + l) % k], b = s[(j + l) % k];
+			if(a == b) {
+				++l;
 				continue;
-			if(reversed(rev) == mer)
-				return true;
+			}
+			if(a > b)
+				i += l + 1;
+			else
+				j += l + 1;
+			if(i == j) ++j;
+			l = 0;
 		}
-		return false;
+		const unsigned r = std::min(i, j);
+
+		uint8_t necklace[mer_ops::k] = {}; // Only the first k bases are used
+		for(unsigned x = 0; x < k; ++x)
+			necklace[x] = s[(r + x) % k];
+
+		// reversed(N) is N rotated left by the length of l^n, i.e., s rotated
+		// left by rot.
+		const unsigned rot = (r + lyndon_power_prefix(k, necklace)) % k;
+		for(unsigned x = 0; rot != 0 && x < k; ++x) {
+			if(s[(rot + x) % k] != s[x])
+				return false;
+		}
+		return true;
 	}
+
+	bool in_champarnaud_set(mer_t mer) const {
+		uint8_t s[mer_ops::k] = {};
+		for(unsigned x = m_k; x > 0; --x, mer /= alpha)
+			s[x - 1] = mer % alpha;
+		return in_champarnaud_set(s);
+	}
+};
+
+
+// Streaming Champarnaud membership over the consecutive mers of a sequence.
+// The bases of the current mer are kept unpacked in a doubled ring buffer (a
+// base is written at position p and p + k), so each window is contiguous and
+// is updated in O(1) per base, instead of decoding the mer with k divisions.
+// If track_rc is true, the reverse complement is maintained as well, its
+// window growing on the left. reset() must be called when the mers are not
+// consecutive (e.g., at the beginning of a record).
+template<typename mer_ops, bool track_rc = false>
+struct champarnaud_stream {
+	typedef typename mer_ops::mer_t mer_t;
+	static constexpr unsigned k = mer_ops::k;
+
+	const index_t<mer_ops>& index;
+
+	champarnaud_stream(const index_t<mer_ops>& i) : index(i) { reset(); }
+
+	void reset() { m_len = 0; }
+
+	// Add the next mer m (with reverse complement rc) of the sequence.
+	void push(mer_t m, mer_t rc) {
+		if(m_len == 0) [[unlikely]] {
+			m_p = m_q = 0;
+			for(unsigned x = k; x > 0; --x, m /= mer_ops::alpha, rc /= mer_ops::alpha) {
+				m_fwd[x - 1] = m_fwd[x - 1 + k] = m % mer_ops::alpha;
+				if constexpr (track_rc)
+					m_rc[x - 1] = m_rc[x - 1 + k] = rc % mer_ops::alpha;
+			}
+		} else {
+			const uint8_t b = mer_ops::rb(m);
+			m_fwd[m_p] = m_fwd[m_p + k] = b;
+			m_p = m_p + 1 == k ? 0 : m_p + 1;
+			if constexpr (track_rc) {
+				m_q = m_q == 0 ? k - 1 : m_q - 1;
+				m_rc[m_q] = m_rc[m_q + k] = mer_ops::alpha - 1 - b;
+			}
+		}
+		++m_len;
+	}
+
+	inline bool in_set() const { return index.in_champarnaud_set(m_fwd + m_p); }
+	inline bool rc_in_set() const {
+		static_assert(track_rc, "Reverse complement not tracked");
+		return index.in_champarnaud_set(m_rc + m_q);
+	}
+
+protected:
+	uint8_t  m_fwd[2 * k], m_rc[2 * k];
+	unsigned m_p, m_q; // Start of the current windows
+	size_t   m_len;
 };
 
 
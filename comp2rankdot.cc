@@ -16,6 +16,7 @@ struct Comp2RankdotArgs : argparse::Args {
     bool& longest_flag = flag("l,longest", "Annotate with longest remaining path");
     std::string& output_arg = kwarg("o,output", "Dot file output").set_default("/dev/stdout");
     bool& progress_flag = flag("p,progress", "Show progress");
+    uint32_t& threads_arg = kwarg("t,threads", "Number of threads to compute the longest paths").set_default(1);
     std::vector<const char*>& mds_arg = arg("MDS").set_default("");
 
     void welcome() override {
@@ -45,12 +46,13 @@ struct fms_index {
     std::vector<mer_t> fms;
     size_t index;
 };
-typedef std::map<std::vector<tristate_t>, fms_index> layer_type;
+typedef std::map<mds_ops::bmds_t, fms_index> layer_type;
 
-std::set<std::vector<tristate_t>> first_layer(const std::vector<tristate_t>& first_bmds, bool progress) {
-    std::set<std::vector<tristate_t>> layer1, layer2;
+std::set<mds_ops::bmds_t> first_layer(const mds_ops::bmds_t& first_bmds, bool progress) {
+    std::set<mds_ops::bmds_t> layer1, layer2;
     layer1.insert(first_bmds);
-    std::vector<tristate_t> nbmds;
+    mds_ops::bmds_t nbmds;
+    std::vector<mer_t> fms;
 
     // Go back and forth with F-moves and RF-moves, starting from the first MDS,
     // to generate the first 2 full layers. Stop when no new MDS in first layer
@@ -62,12 +64,11 @@ std::set<std::vector<tristate_t>> first_layer(const std::vector<tristate_t>& fir
         if(progress)
             std::cerr << '\r' << layer1.size() << ' ' << layer2.size() << std::flush;
         for(const auto& bmds : layer1) {
-            for(mer_t fm = 0; fm < mer_ops::nb_fmoves; ++fm) {
-                if(mds_ops::has_fm(bmds, fm)) {
-                    nbmds = bmds;
-                    mds_ops::do_fmove(fm, nbmds);
-                    layer2.insert(nbmds);
-                }
+            mds_ops::all_fmoves(bmds, fms);
+            for(const auto fm : fms) {
+                nbmds = bmds;
+                mds_ops::do_fmove(fm, nbmds);
+                layer2.insert(nbmds);
             }
         }
 
@@ -75,14 +76,13 @@ std::set<std::vector<tristate_t>> first_layer(const std::vector<tristate_t>& fir
         if(progress)
             std::cerr << '\r' << layer1.size() << ' ' << layer2.size() << std::flush;
         for(const auto& bmds : layer2) {
-            for(mer_t rfm = 0; rfm < mer_ops::nb_fmoves; ++rfm) {
-                if(mds_ops::has_rfm(bmds, rfm)) {
-                    nbmds = bmds;
-                    mds_ops::do_rfmove(rfm, nbmds);
-                    auto it = layer1.insert(nbmds);
-                    if(it.second)
-                        done = false; // New element in layer1, not done
-                }
+            mds_ops::all_rfmoves(bmds, fms);
+            for(const auto rfm : fms) {
+                nbmds = bmds;
+                mds_ops::do_rfmove(rfm, nbmds);
+                auto it = layer1.insert(nbmds);
+                if(it.second)
+                    done = false; // New element in layer1, not done
             }
         }
     }
@@ -101,11 +101,11 @@ int main(int argc, char* argv[]) {
     std::ios::sync_with_stdio(false);
     const auto args = argparse::parse<Comp2RankdotArgs>(argc, argv);
 
-    std::vector<tristate_t> first_bmds;
+    mds_ops::bmds_t first_bmds;
     std::vector<mer_t> first_fms, mds;
     mds = mds_from_arg<mer_t>(args.mds_arg);
     mds_ops::from_mds_fms(mds, first_bmds, first_fms);
-    auto lp = std::unique_ptr<longest_path>(args.longest_flag ? new longest_path : nullptr);
+    auto lp = std::unique_ptr<longest_path>(args.longest_flag ? new longest_path(args.threads_arg) : nullptr);
     std::pair<mer_t, mer_t> lprange{std::numeric_limits<mer_t>::max(), 0}, llprange; // Longest path ranges (global and per layer)
     std::pair<mer_t, mer_t> sprange(std::numeric_limits<mer_t>::max(), 0), lsprange; // Shortest path ranges
     std::pair<mer_t, mer_t> width_range; // Min and max width of a layer
@@ -130,10 +130,7 @@ int main(int argc, char* argv[]) {
         const auto mdss = first_layer(first_bmds, args.progress_flag);
         for(auto& bmds : mdss) {
             std::vector<mer_t> fms;
-            for(mer_t fm = 0; fm < mer_ops::nb_fmoves; ++fm) {
-                if(mds_ops::has_fm(bmds, fm))
-                    fms.push_back(fm);
-            }
+            mds_ops::all_fmoves(bmds, fms);
             fms_index val{std::move(fms), mds_info::total++};
             olayer.emplace(std::move(bmds), std::move(val));
         }
@@ -166,7 +163,7 @@ int main(int argc, char* argv[]) {
     layer_type* l1 = &layer1;
     layer_type* l2 = &layer2;
     std::vector<std::vector<std::pair<mer_t, mer_t>>> fms_ranges(mer_ops::nb_fmoves); // Ranges where F-move is used
-    std::vector<tristate_t> nbmds;
+    mds_ops::bmds_t nbmds;
     std::vector<mer_t> nfms;
     struct edge_type { size_t n1, n2; mer_t fm; };
     std::vector<edge_type> edges;
@@ -0,0 +1,37 @@
+#include <iostream>
+#include <string>
+
+#include "argparse.hpp"
+#include "mer_op.hpp"
+#include "file_queue.hpp"
+#include "common.hpp"
+
+typedef mer_op_type<K, ALPHA> mer_ops;
+
+struct Comps2TextArgs : argparse::Args {
+    std::string& comps_arg = arg("Component file");
+
+    void welcome() {
+        std::cout <<
+            "Convert a binary component file (output of traverse_comp) to text\n"
+            "One component per line: index, F-moves, number of I-moves and I-moves, tab separated."
+            << std::endl;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    const auto args = argparse::parse<Comps2TextArgs>(argc, argv);
+
+    comp_reader<mer_ops> reader(args.comps_arg.c_str());
+    queue_elt<mer_ops> elt;
+    while(reader.next(elt))
+        std::cout << elt << '\n';
+
+    if(reader.error) {
+        std::cerr << "Malformed component file " << args.comps_arg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+#ifndef EXTERNAL_SORT_H_
+#define EXTERNAL_SORT_H_
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <queue>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+
+#include "file_queue.hpp"
+
+// Files of length-prefixed binary records (same framing as the component
+// file). The Codec provides:
+//   static void encode(std::string& buf, const T& x); // Append payload of x
+//   static bool decode(const char* ptr, const char* end, T& x);
+template<typename T, typename Codec>
+class record_writer {
+	std::ofstream _os;
+	std::string   _buffer, _payload;
+	static constexpr size_t buffer_size = (size_t)1 << 16;
+
+public:
+	record_writer(const std::string& path)
+		: _os(path, std::ios::out | std::ios::trunc | std::ios::binary)
+	{
+		if(!_os.good())
+			throw std::runtime_error("Failed to open record file " + path);
+	}
+
+	void write(const T& x) {
+		_payload.clear();
+		Codec::encode(_payload, x);
+		record::put_varint(_buffer, _payload.size());
+		_buffer += _payload;
+		if(_buffer.size() >= buffer_size)
+			flush();
+	}
+
+	void flush() {
+		_os.write(_buffer.data(), _buffer.size());
+		_buffer.clear();
+	}
+
+	void close() {
+		flush();
+		_os.close();
+		if(_os.fail())
+			throw std::runtime_error("Failed to write record file");
+	}
+};
+
+template<typename T, typename Codec>
+class record_reader {
+	std::ifstream _is;
+	std::string   _buffer;
+
+public:
+	record_reader(const std::string& path)
+		: _is(path, std::ios::in | std::ios::binary)
+	{
+		if(!_is.good())
+			throw std::runtime_error("Failed to open record file " + path);
+	}
+
+	// Next record. Returns false at the end of the file. Throws if the file
+	// is malformed.
+	bool next(T& x) {
+		if(_is.peek() == std::char_traits<char>::eof()) return false;
+		if(!record::get_payload(_is, _buffer) || !Codec::decode(_buffer.data(), _buffer.data() + _buffer.size(), x))
+			throw std::runtime_error("Malformed record file");
+		return true;
+	}
+};
+
+// First phase of an external memory sort. The records are accumulated in
+// memory, and when their size reaches the budget, they are sorted and written
+// to a new run file (path prefix followed by the run number).
+template<typename T, typename Codec, typename Less>
+class run_sorter {
+	const std::string        _prefix;
+	const size_t             _max_bytes;
+	const Less               _less;
+	std::vector<T>           _records;
+	size_t                   _bytes;
+	std::vector<std::string> _runs;
+
+public:
+	run_sorter(const std::string& prefix, size_t max_bytes, Less less = Less())
+		: _prefix(prefix)
+		, _max_bytes(max_bytes)
+		, _less(less)
+		, _bytes(0)
+		{}
+
+	// Add a record, taking about bytes of memory
+	void add(T&& x, size_t bytes) {
+		_records.push_back(std::move(x));
+		_bytes += bytes;
+		if(_bytes >= _max_bytes)
+			write_run();
+	}
+
+	// Write the records left in memory
+	void finish() {
+		if(!_records.empty())
+			write_run();
+	}
+
+	const std::vector<std::string>& runs() const { return _runs; }
+
+	// Delete the run files
+	void clear() {
+		for(const auto& path : _runs)
+			std::filesystem::remove(path);
+		_runs.clear();
+	}
+
+protected:
+	void write_run() {
+		std::sort(_records.begin(), _records.end(), _less);
+		_runs.push_back(_prefix + std::to_string(_runs.size()));
+		record_writer<T, Codec> writer(_runs.back());
+		for(const auto& x : _records)
+			writer.write(x);
+		writer.close();
+		_records.clear();
+		_bytes = 0;
+	}
+};
+
+// Second phase of an external memory sort: k-way merge of sorted run files.
+template<typename T, typename Codec, typename Less>
+class run_merger {
+	typedef record_reader<T, Codec> reader_type;
+	std::vector<std::unique_ptr<reader_type>> _readers;
+	std::vector<T>                            _heads; // Current record of each run
+
+	struct greater_head {
+		const run_merger& m;
+		const Less&       less;
+		bool operator()(size_t i, size_t j) const { return less(m._heads[j], m._heads[i]); }
+	};
+	const Less _less;
+	std::priority_queue<size_t, std::vector<size_t>, greater_head> _queue;
+
+public:
+	run_merger(const std::vector<std::string>& runs, Less less = Less())
+		: _heads(runs.size())
+		, _less(less)
+		, _queue(greater_head{*this, _less})
+	{
+		for(size_t i = 0; i < runs.size(); ++i) {
+			_readers.emplace_back(new reader_type(runs[i]));
+			if(_readers[i]->next(_heads[i]))
+				_queue.push(i);
+		}
+	}
+
+	// Next record in sorted order. Returns false when all the runs are
+	// exhausted.
+	bool next(T& x) {
+		if(_queue.empty()) return false;
+		const size_t i = _queue.top();
+		_queue.pop();
+		x = std::move(_heads[i]);
+		if(_readers[i]->next(_heads[i]))
+			_queue.push(i);
+		return true;
+	}
+};
+
+#endif // EXTERNAL_SORT_H_
@@ -2,6 +2,8 @@
 #define FILE_QUEUE_H_
 
 #include <fstream>
+#include <string>
+#include <stdexcept>
 
 #include "mer_op.hpp"
 #include "imove_signature.hpp"
@@ -63,7 +65,151 @@ std::ostream& operator<<(std::ostream& os, const queue_elt<mer_op_type>& elt) {
               << join(elt.ims, ' ');
 }
 
-// Queue made by reading/writing a file from "both ends".
+// Binary encoding of a queue_elt. A record is the length of its payload
+// (varint) followed by the payload:
+//  - the index (varint),
+//  - the nb_fmoves F-moves, in order, each as the delta with the previous one
+//    (the first with 0),
+//  - the number of I-moves (varint), then each I-move as the delta of its fm
+//    with the previous one and its mask (1 byte).
+// A delta is stored as a varint whose first byte holds 6 bits of the absolute
+// value and the sign, so it works for any width of mer_t.
+namespace record {
+template<typename T>
+inline void put_varint(std::string& buf, T x) {
+    for( ; x >= 0x80; x >>= 7)
+        buf.push_back((char)((x & 0x7f) | 0x80));
+    buf.push_back((char)x);
+}
+
+template<typename T>
+inline void put_delta(std::string& buf, T x, T prev) {
+    const bool neg = x < prev;
+    T d = neg ? prev - x : x - prev;
+    const char first = (char)((d & 0x3f) | (neg ? 0x40 : 0) | (d >= 0x40 ? 0x80 : 0));
+    buf.push_back(first);
+    if(d >= 0x40)
+        put_varint(buf, (T)(d >> 6));
+}
+
+// Decoding from [ptr, end). Return nullptr on error.
+template<typename T>
+inline const char* get_varint(const char* ptr, const char* end, T& x) {
+    x = 0;
+    for(unsigned shift = 0; ptr < end && shift < 8 * sizeof(T); shift += 7) {
+        const uint8_t c = *ptr++;
+        x |= (T)(c & 0x7f) << shift;
+        if(!(c & 0x80)) return ptr;
+    }
+    return nullptr;
+}
+
+template<typename T>
+inline const char* get_delta(const char* ptr, const char* end, T prev, T& x) {
+    if(ptr >= end) return nullptr;
+    const uint8_t c = *ptr++;
+    T d = c & 0x3f;
+    if(c & 0x80) {
+        T high;
+        if(!(ptr = get_varint(ptr, end, high))) return nullptr;
+        d |= high << 6;
+    }
+    x = (c & 0x40) ? prev - d : prev + d;
+    return ptr;
+}
+
+// I-moves signature: number of I-moves, then delta of fm and mask of each
+template<typename mer_op_type>
+void put_ims(std::string& buf, const imove_sig_type<mer_op_type>& ims) {
+    typedef typename mer_op_type::mer_t mer_t;
+    put_varint(buf, ims.size());
+    mer_t prev = 0;
+    for(const auto& im : ims) {
+        put_delta(buf, im.fm, prev);
+        buf.push_back((char)im.im);
+        prev = im.fm;
+    }
+}
+
+template<typename mer_op_type>
+const char* get_ims(const char* ptr, const char* end, imove_sig_type<mer_op_type>& ims) {
+    typedef typename mer_op_type::mer_t mer_t;
+    size_t nb_ims;
+    if(!(ptr = get_varint(ptr, end, nb_ims))) return nullptr;
+    ims.resize(nb_ims);
+    mer_t prev = 0;
+    for(auto& im : ims) {
+        if(!(ptr = get_delta(ptr, end, prev, im.fm)) || ptr >= end) return nullptr;
+        im.im = *ptr++;
+        prev = im.fm;
+    }
+    return ptr;
+}
+
+// Read the payload of a length-prefixed record into buf. Returns false at
+// the end of the stream or if the record is truncated.
+inline bool get_payload(std::istream& is, std::string& buf) {
+    size_t len = 0;
+    for(unsigned shift = 0; ; shift += 7) {
+        const auto c = is.get();
+        if(c == std::char_traits<char>::eof() || shift >= 64) return false;
+        len |= (size_t)(c & 0x7f) << shift;
+        if(!(c & 0x80)) break;
+    }
+    buf.resize(len);
+    return (bool)is.read(buf.data(), len);
+}
+} // namespace record
+
+// Append the payload of elt to buf
+template<typename mer_op_type>
+void encode_payload(std::string& payload, const queue_elt<mer_op_type>& elt) {
+    typedef typename mer_op_type::mer_t mer_t;
+    record::put_varint(payload, elt.index);
+    mer_t prev = 0;
+    for(const mer_t fm : elt.fms) {
+        record::put_delta(payload, fm, prev);
+        prev = fm;
+    }
+    record::put_ims<mer_op_type>(payload, elt.ims);
+}
+
+// Append the record (length and payload) of elt to buf
+template<typename mer_op_type>
+void encode(std::string& buf, const queue_elt<mer_op_type>& elt) {
+    const size_t start = buf.size();
+    encode_payload(buf, elt);
+    std::string len;
+    record::put_varint(len, buf.size() - start);
+    buf.insert(start, len);
+}
+
+// Decode the payload in [ptr, end)
+template<typename mer_op_type>
+bool decode(const char* ptr, const char* end, queue_elt<mer_op_type>& elt) {
+    typedef typename mer_op_type::mer_t mer_t;
+    elt.fms.resize(mer_op_type::nb_fmoves);
+
+    if(!(ptr = record::get_varint(ptr, end, elt.index))) return false;
+    mer_t prev = 0;
+    for(auto& fm : elt.fms) {
+        if(!(ptr = record::get_delta(ptr, end, prev, fm))) return false;
+        prev = fm;
+    }
+    ptr = record::get_ims<mer_op_type>(ptr, end, elt.ims);
+    return ptr == end;
+}
+
+// Read one binary record from a stream. Returns false at the end of the stream
+// or if the record is malformed.
+template<typename mer_op_type>
+bool read_record(std::istream& is, queue_elt<mer_op_type>& elt, std::string& buf) {
+    return record::get_payload(is, buf) && decode(buf.data(), buf.data() + buf.size(), elt);
+}
+
+// Queue made by reading/writing a file from "both ends". The elements are
+// stored in the binary format above. The writes are buffered, and flushed
+// only when the reading end needs them.
 template<typename mer_op_type>
 struct comp_queue {
     typedef mer_op_type mer_op_t;
@@ -73,35 +219,75 @@ struct comp_queue {
 
     std::ofstream right; // Must open writing end first
     std::ifstream left;
+    std::string buffer;
 
-    comp_queue(const char* path)
-    : right(path, std::ios::out | std::ios::trunc)
-    , left(path)
+    // If append is true, the file is not truncated and new elements are added
+    // at the end.
+    comp_queue(const char* path, bool append = false)
+    : right(path, std::ios::out | (append ? std::ios::in : std::ios::trunc) | std::ios::binary)
+    , left(path, std::ios::in | std::ios::binary)
     {
         if(!left.good())
             throw std::runtime_error("Failed to open queue file for reading");
         if(!right.good())
             throw std::runtime_error("Failed to open queue file for writing");
+        if(append)
+            right.seekp(0, std::ios::end);
     }
 
     bool empty() { return left.tellg() == right.tellp(); }
 
+    // Position of the next element enqueued
+    std::streampos tell() { return right.tellp(); }
+
     // Read and return first element, advancing by 1 element. Returns false if
     // not successful.
     bool dequeue(queue_elt_t& elt) {
         if(empty()) return false;
-        left >> elt;
-        if(left.peek() != '\n') return false;
-        if(!left.good()) return false;
-        left.get(); // Skip new line
+        right.flush();
+        return read_record(left, elt, buffer);
+    }
 
-        return left.good();
+    // Read the element at position pos (as returned by tell() before it was
+    // enqueued). The next dequeue() returns the following element.
+    bool dequeue_at(std::streampos pos, queue_elt_t& elt) {
+        left.clear();
+        left.seekg(pos);
+        return dequeue(elt);
     }
 
     bool enqueue(const queue_elt_t& elt) {
-        right << elt << std::endl; // std::flush;
+        buffer.clear();
+        encode(buffer, elt);
+        right.write(buffer.data(), buffer.size());
         return right.good();
     }
 };
 
+// Sequential reader of a component file written by comp_queue.
+template<typename mer_op_type>
+struct comp_reader {
+    std::ifstream is;
+    std::string buffer;
+    bool error = false; // Malformed or truncated record
+
+    comp_reader(const char* path)
+    : is(path, std::ios::in | std::ios::binary)
+    {
+        if(!is.good())
+            throw std::runtime_error("Failed to open component file for reading");
+    }
+
+    // Position of the next element
+    std::streampos tell() { return is.tellg(); }
+
+    // Next element. Returns false at the end of the file or on error.
+    bool next(queue_elt<mer_op_type>& elt) {
+        if(is.peek() == std::char_traits<char>::eof()) return false;
+        if(read_record(is, elt, buffer)) return true;
+        error = true;
+        return false;
+    }
+};
+
 #endif // FILE_QUEUE_H_
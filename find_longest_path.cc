@@ -19,6 +19,7 @@ typedef longest_path_type<mer_ops> longest_path;
 
 struct LongestPathArgs : argparse::Args {
     std::optional<const char*>& mds_arg = kwarg("f,mds", "File with MDS");
+    uint32_t& threads_arg = kwarg("t,threads", "Number of threads").set_default(1);
     std::vector<const char*>& comp_arg = arg("component").set_default("");
 
     void welcome() override {
@@ -28,7 +29,7 @@ struct LongestPathArgs : argparse::Args {
 
 int main(int argc, char* argv[]) {
     const auto args = argparse::parse<LongestPathArgs>(argc, argv);
-    longest_path lp;
+    longest_path lp(args.threads_arg);
 
     const auto mds = args.mds_arg ? mds_from_file<mer_t>(*args.mds_arg) : mds_from_arg<mer_t>(args.comp_arg);
     std::cout << (size_t)lp.longest_path(mds) << '\n';
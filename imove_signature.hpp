@@ -7,6 +7,11 @@
 #include <ostream>
 #include <istream>
 #include <cstring>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <limits>
+#include <algorithm>
 
 #include "mer_op.hpp"
 #include "common.hpp"
@@ -92,4 +97,144 @@ struct hash<imove_sig_type<mer_op_type>> {
 template<typename mer_op_type>
 using signatures_type = std::unordered_map<imove_sig_type<mer_op_type>, size_t>;
 
+// Concurrent set of signatures, each associated with a unique index (given in
+// order of insertion). Sharded on the hash of the signature: each shard is a
+// map with its own lock, so threads rarely wait on each other.
+template<typename mer_op_type>
+struct sharded_signatures_type {
+    typedef imove_sig_type<mer_op_type> key_type;
+    static constexpr unsigned shard_bits = 6;
+
+    struct alignas(64) shard_type {
+        std::mutex lock;
+        signatures_type<mer_op_type> map;
+    };
+    std::vector<shard_type> shards;
+    std::atomic<size_t> m_size;
+
+    sharded_signatures_type()
+        : shards((size_t)1 << shard_bits)
+        , m_size(0)
+        {}
+
+    // Insert the signature if new. Returns its index and whether it was
+    // inserted.
+    std::pair<size_t, bool> insert(const key_type& sig) {
+        auto& shard = shards[std::hash<key_type>()(sig) >> (64 - shard_bits)];
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto res = shard.map.try_emplace(sig, 0);
+        if(res.second)
+            res.first->second = m_size++;
+        return std::make_pair(res.first->second, res.second);
+    }
+
+    // Insert a signature with a given index (e.g., when resuming a
+    // traversal). Not to be mixed with concurrent calls to insert().
+    void restore(const key_type& sig, size_t index) {
+        auto& shard = shards[std::hash<key_type>()(sig) >> (64 - shard_bits)];
+        shard.map[sig] = index;
+        if(index >= m_size)
+            m_size = index + 1;
+    }
+
+    size_t size() const { return m_size; }
+};
+
+// Concurrent set of signature fingerprints, each associated with a unique
+// index. Only the 128-bit XXH3 hash of a signature is stored: two signatures
+// with the same fingerprint are considered equal (with n signatures, the
+// probability of a collision is about n^2 / 2^129). An entry is 24 bytes
+// (fingerprint and index), but the tables are kept between 1/4 and 1/2 full,
+// so the memory usage is about 48 to 96 bytes per signature (3 times more
+// while a stripe grows). There is no heap allocation per signature, unlike
+// the exact sharded_signatures_type.
+//
+// The table is split into stripes on the high bits of the fingerprint. Each
+// stripe is an open addressing table (linear probing, load at most 1/2) with
+// its own lock.
+template<typename mer_op_type>
+struct fingerprint_signatures_type {
+    typedef imove_sig_type<mer_op_type> key_type;
+    static constexpr unsigned stripe_bits = 6;
+    static constexpr uint64_t seed = 0xd336ea32c33ce21fUL;
+    static constexpr size_t empty = std::numeric_limits<size_t>::max();
+
+    struct entry_type {
+        XXH128_hash_t fp;
+        size_t index = empty;
+    };
+    struct alignas(64) stripe_type {
+        std::mutex lock;
+        std::vector<entry_type> table; // Size is a power of 2
+        size_t used = 0;
+    };
+    std::vector<stripe_type> stripes;
+    std::atomic<size_t> m_size;
+
+    fingerprint_signatures_type()
+        : stripes((size_t)1 << stripe_bits)
+        , m_size(0)
+        {}
+
+    static XXH128_hash_t fingerprint(const key_type& sig) {
+        return XXH3_128bits_withSeed(sig.data(), sig.size() * sizeof(imove_type<mer_op_type>), seed);
+    }
+
+    // Insert the signature if its fingerprint is new. Returns its index and
+    // whether it was inserted.
+    std::pair<size_t, bool> insert(const key_type& sig) {
+        const auto fp = fingerprint(sig);
+        auto& stripe = stripes[fp.high64 >> (64 - stripe_bits)];
+        std::lock_guard<std::mutex> guard(stripe.lock);
+        if(2 * (stripe.used + 1) > stripe.table.size())
+            grow(stripe);
+
+        auto& entry = find(stripe.table, fp);
+        if(entry.index != empty)
+            return std::make_pair(entry.index, false);
+        entry.fp = fp;
+        entry.index = m_size++;
+        ++stripe.used;
+        return std::make_pair(entry.index, true);
+    }
+
+    // Insert a signature with a given index (e.g., when resuming a
+    // traversal). Not to be mixed with concurrent calls to insert().
+    void restore(const key_type& sig, size_t index) {
+        const auto fp = fingerprint(sig);
+        auto& stripe = stripes[fp.high64 >> (64 - stripe_bits)];
+        if(2 * (stripe.used + 1) > stripe.table.size())
+            grow(stripe);
+        auto& entry = find(stripe.table, fp);
+        if(entry.index == empty)
+            ++stripe.used;
+        entry.fp = fp;
+        entry.index = index;
+        if(index >= m_size)
+            m_size = index + 1;
+    }
+
+    size_t size() const { return m_size; }
+
+private:
+    // Entry with fingerprint fp, or the empty entry where it belongs
+    static entry_type& find(std::vector<entry_type>& table, const XXH128_hash_t& fp) {
+        const size_t mask = table.size() - 1;
+        for(size_t i = fp.low64 & mask; ; i = (i + 1) & mask) {
+            auto& entry = table[i];
+            if(entry.index == empty || XXH128_isEqual(entry.fp, fp))
+                return entry;
+        }
+    }
+
+    static void grow(stripe_type& stripe) {
+        std::vector<entry_type> table(std::max((size_t)16, 2 * stripe.table.size()));
+        for(const auto& entry : stripe.table) {
+            if(entry.index != empty)
+                find(table, entry.fp) = entry;
+        }
+        stripe.table.swap(table);
+    }
+};
+
 #endif // IMOVE_SIGNATURE_H_
@@ -5,11 +5,16 @@
 #include <algorithm>
 #include <bitset>
 #include <cstdint>
+#include <atomic>
+#include <functional>
+#include <memory>
 
 #include "common.hpp"
 #include "mer_op.hpp"
 #include "mds_op.hpp"
 #include "imove_signature.hpp"
+#include "tristate_vector.hpp"
+#include "simple_thread_pool.hpp"
 
 // Encodes the constrains between lc/rc around an F-move.
 template<typename mer_op_type>
@@ -43,15 +48,21 @@ struct imoves_type {
     typedef imove_type<mer_op_type> imove_t;
     typedef imove_sig_type<mer_op_type> imove_sig_t;
     typedef typename imove_t::mask_type mask_t;
+    typedef tristate_vector<mer_op_type> bmds_t;
 
     std::vector<f_constrains<mer_op_type>> constrained;
-    std::vector<tristate_t> visited;
+    // Result of the DFS from each mer, for the current DFS only: mer has been
+    // visited if visited[mer] >> 1 == epoch, and the low bit is the result.
+    // Starting a new DFS is incrementing the epoch, not clearing the array.
+    std::vector<uint32_t> visited;
+    uint32_t epoch;
     // std::vector<mer_t> mds;
     std::vector<bool> done;
 
     imoves_type()
         : constrained(mer_op_t::nb_fmoves)
-        , visited(mer_op_t::nb_mers)
+        , visited(mer_op_t::nb_mers, 0)
+        , epoch(0)
         // , mds(mer_op_t::nb_mers)
         , done(mer_op_t::nb_fmoves)
     { }
@@ -78,19 +89,23 @@ struct imoves_type {
 
     void visit_all(const std::vector<mer_t>& mds) {
         for(const auto mer : mds) {
-            std::fill(visited.begin(), visited.end(), nil);
+            new_visit();
             visit(mer, mer, mds, false);
         }
     }
 
-    void visit_all(const std::vector<tristate_t>& bmds) {
-         // mds.clear();
-        for(mer_t mer = 0; mer < mer_op_t::nb_mers; ++mer) {
-            if(includes(bmds, mer)) {
-                // mds.push_back(mer);
-                std::fill(visited.begin(), visited.end(), nil);
-                visit(mer, mer, bmds, false);
-            }
+    void visit_all(const bmds_t& bmds) {
+        bmds.for_each_yes([&](mer_t mer) {
+            new_visit();
+            visit(mer, mer, bmds, false);
+        });
+    }
+
+    // Forget the visited mers
+    inline void new_visit() {
+        if(++epoch == (uint32_t)1 << 31) { // Wrap around
+            std::fill(visited.begin(), visited.end(), 0);
+            epoch = 1;
         }
     }
 
@@ -98,41 +113,82 @@ struct imoves_type {
         return std::binary_search(mds.cbegin(), mds.cend(), m);
     }
 
-    inline static bool includes(const std::vector<tristate_t>& mds, const mer_t m) {
-        return mds[m] == yes;
+    inline static bool includes(const bmds_t& mds, const mer_t m) {
+        return mds.is_yes(m);
     }
 
+    // DFS from mer in the de Bruijn graph minus mds, looking for cycles back to
+    // start with hitting number 1 which use at least one F-move (an edge to a
+    // left companion of the successor on the PCR). The edges on such cycles
+    // are marked as constrained. Returns true if start is reached from mer
+    // (having used an F-move if used_fmove is false).
+    //
+    // Iterative with an explicit stack (a path of non-MDS mers can be long).
     template<typename C>
     bool visit(mer_t start, mer_t mer, const C& mds, bool used_fmove) {
-        // std::cout << "visit " << start << ' ' << mer << ' ' << used_fmove << std::endl;
-        if(visited[mer] != nil && used_fmove) return visited[mer] == yes;
-
-        bool res = false;
-        const auto nmer = mer_op_t::nmer(mer);
-        const auto cycling = mer_op_t::rb(nmer); // Using that base is staying on PCR
-
-        // std::cout << "\tinfo " << nmer << ' ' << cycling << std::endl;
-
-        for(mer_t b = 0; b < mer_op_t::alpha; ++b) {
-            // const auto b = (cycling + i) % mer_op_t::alpha;
-            bool ufm = b != cycling; // Traversing a FM
-            const mer_t m = mer_op_t::rc(nmer, b);
-            // std::cout << "\tloop " << m << ' ' << b << ' ' << ufm << std::endl;
-            if(m == start) {
-                if(used_fmove) {
-                    if(ufm) constrained[mer_op_t::fmove(mer)].set(mer_op_t::lb(mer), b);
-                    res = true;
+        if(used_fmove && (visited[mer] >> 1) == epoch) return visited[mer] & 1;
+
+        stack.clear();
+        stack.push_back({mer, 0, used_fmove, false});
+        bool nres = false; // Result of the last frame popped
+        bool returning = false;
+        while(true) {
+            auto& f = stack.back();
+            const auto nmer = mer_op_t::nmer(f.mer);
+            const auto cycling = mer_op_t::rb(nmer); // Using that base is staying on PCR
+            if(returning) { // From the DFS of the successor with base f.b
+                returning = false;
+                child_done(f, cycling, nres);
+                ++f.b;
+            }
+
+            bool descend = false;
+            for( ; f.b < mer_op_t::alpha; ++f.b) {
+                const bool ufm = f.b != cycling; // Traversing a FM
+                const mer_t m = mer_op_t::rc(nmer, f.b);
+                if(m == start) {
+                    if(f.used) {
+                        if(ufm) mark(f.mer, f.b);
+                        f.res = true;
+                    }
+                } else if(!includes(mds, m)) {
+                    const bool nused = f.used || ufm;
+                    if(nused && (visited[m] >> 1) == epoch) {
+                        child_done(f, cycling, visited[m] & 1);
+                    } else {
+                        stack.push_back({m, 0, nused, false});
+                        descend = true;
+                        break;
+                    }
                 }
-            } else if(!includes(mds, m)) {
-                // std::cout << "\trecurse " << m << ' ' << b << ' ' << ufm << std::endl;
-                const bool nres = visit(start, m, mds, used_fmove || ufm);
-                res = res || nres;
-                if(nres && ufm) constrained[mer_op_t::fmove(mer)].set(mer_op_t::lb(mer), b);
             }
+            if(descend) continue;
+
+            if(f.used) visited[f.mer] = (epoch << 1) | f.res;
+            nres = f.res;
+            stack.pop_back();
+            if(stack.empty()) return nres;
+            returning = true;
         }
+    }
 
-        if(used_fmove) visited[mer] = res ? yes : no;
-        return res;
+    struct frame_type {
+        mer_t mer;
+        mer_t b; // Next base to explore
+        bool  used; // F-move used on the path from start
+        bool  res; // start reached from mer
+    };
+    std::vector<frame_type> stack;
+
+    // The DFS from successor m = rc(nmer(f.mer), f.b) of f.mer returned nres
+    inline void child_done(frame_type& f, mer_t cycling, bool nres) {
+        if(!nres) return;
+        f.res = true;
+        if(f.b != cycling) mark(f.mer, f.b);
+    }
+
+    inline void mark(mer_t mer, mer_t b) {
+        constrained[mer_op_t::fmove(mer)].set(mer_op_t::lb(mer), b);
     }
 
     template<typename C>
@@ -145,8 +201,13 @@ struct imoves_type {
     // I-moves are set of unconstrained edges
     template<typename C>
     void imoves(const C& mds, imove_sig_t& res) {
-        res.clear();
         fill_constrained(mds);
+        signature(res);
+    }
+
+    // Fill res with the I-moves allowed by constrained
+    void signature(imove_sig_t& res) {
+        res.clear();
 
         // For combination of F-moves and mask, find those that are not
         // constrained. If f is the homopolymer f = i^(k-1) with i \in \Sigma,
@@ -192,6 +253,82 @@ struct imoves_type {
             }
         }
     }
+
+};
+
+// Same as imoves_type::imoves, using multiple threads. The DFSs from the mers
+// of the MDS are independent: they are split between the threads, each with
+// its own imoves_type (visited array and constraints), and the constraints
+// are merged at the end. Not multi-thread safe itself.
+template<typename mer_op_type>
+struct parallel_imoves_type {
+    typedef typename mer_op_type::mer_t mer_t;
+    typedef imoves_type<mer_op_type> imoves_t;
+    typedef typename imoves_t::imove_sig_t imove_sig_t;
+
+    const unsigned nb_threads;
+    std::vector<imoves_t> imoves_ops; // One per thread
+    std::vector<mer_t> starts;
+
+    // With 1 thread, imoves() calls imoves_type::imoves() and no thread pool
+    // is started.
+    parallel_imoves_type(unsigned threads)
+        : nb_threads(std::max(1u, threads))
+        , imoves_ops(nb_threads)
+    {
+        if(nb_threads > 1)
+            m_pool.reset(new simple_thread_pool<std::function<void(int)>>(nb_threads));
+    }
+
+    ~parallel_imoves_type() {
+        if(m_pool) m_pool->stop();
+    }
+
+    template<typename C>
+    imove_sig_t imoves(const C& mds) {
+        imove_sig_t res;
+        imoves(mds, res);
+        return res;
+    }
+
+    template<typename C>
+    void imoves(const C& mds, imove_sig_t& res) {
+        if(nb_threads == 1) {
+            imoves_ops[0].imoves(mds, res);
+            return;
+        }
+
+        set_starts(mds);
+        m_next = 0;
+        m_pool->set_work([&](int th) {
+            auto& op = imoves_ops[th];
+            for(auto& c : op.constrained)
+                c.reset();
+            for(size_t i = m_next++; i < starts.size(); i = m_next++) {
+                op.new_visit();
+                op.visit(starts[i], starts[i], mds, false);
+            }
+        });
+        m_pool->start();
+
+        auto& constrained = imoves_ops[0].constrained;
+        for(unsigned th = 1; th < nb_threads; ++th) {
+            const auto& oconstrained = imoves_ops[th].constrained;
+            for(mer_t fm = 0; fm < mer_op_type::nb_fmoves; ++fm)
+                constrained[fm].bits |= oconstrained[fm].bits;
+        }
+        imoves_ops[0].signature(res);
+    }
+
+protected:
+    std::unique_ptr<simple_thread_pool<std::function<void(int)>>> m_pool;
+    std::atomic<size_t> m_next;
+
+    void set_starts(const std::vector<mer_t>& mds) { starts = mds; }
+    void set_starts(const tristate_vector<mer_op_type>& bmds) {
+        starts.clear();
+        bmds.for_each_yes([&](mer_t m) { starts.push_back(m); });
+    }
 };
 
 #endif // _IMOVES_H_
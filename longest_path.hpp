@@ -5,37 +5,71 @@
 #include <queue>
 #include <stack>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <unistd.h>
 
 #include "common.hpp"
 #include "misc.hpp"
 #include "mds_op.hpp"
 #include "dbg.hpp"
-#include "mds_op.hpp"
+#include "tristate_vector.hpp"
+#include "mt_queue.hpp"
+#include "simple_thread_pool.hpp"
 
 // Returns the longest path in number of k-mers/nodes in the de Bruijn graph
-// decycled by bmds. (NOTE: bmds is copied as a vector.) So the longest string
-// is longest + k - 1
+// decycled by bmds. (NOTE: bmds is copied.) So the longest string
+// is longest + k - 1. The scratch space is allocated once in the constructor,
+// so the calls do not allocate memory.
 template<typename mer_op_type>
 struct longest_path_type {
     typedef typename mer_op_type::mer_t mer_t;
     typedef mds_op_type<mer_op_type> mds_ops;
-    std::vector<tristate_t> visited;
-    longest_path_type()
-        : visited(mer_op_type::nb_mers, no)
-        {}
+    typedef tristate_vector<mer_op_type> bmds_t;
+    bmds_t visited;
+    const unsigned nb_threads;
+
+    // With more than 1 thread, longest_path(bmds, fms) is computed level by
+    // level with parallel_longest_path().
+    longest_path_type(unsigned threads = 1)
+        : visited(no)
+        , nb_threads(std::max(1u, threads))
+        , m_paths(mer_op_type::nb_mers)
+        , m_bfs(mer_op_type::nb_mers)
+    {
+        m_indeg0.reserve(mer_op_type::nb_mers);
+        m_fms.reserve(mer_op_type::nb_fmoves);
+        if(nb_threads > 1) {
+            m_remaining = std::vector<std::atomic<uint8_t>>(mer_op_type::nb_fmoves);
+            m_queue.reset(new mt_queue<mer_t>(mer_op_type::nb_mers + nb_threads * (getpagesize() / sizeof(mer_t))));
+            m_processed = std::vector<thread_count>(nb_threads);
+            m_pool.reset(new simple_thread_pool<std::function<void(int)>>(nb_threads));
+        }
+    }
+
+    ~longest_path_type() {
+        if(m_pool) m_pool->stop();
+    }
+
+    mer_t longest_path(const bmds_t& bmds, const std::vector<mer_t>& fms) {
+        if(nb_threads > 1)
+            return parallel_longest_path(bmds, fms);
 
-    mer_t longest_path(const std::vector<tristate_t>& bmds, const std::vector<mer_t>& fms) {
-        assert2(bmds.size() == visited.size(), "Wrong bmds input bmds size");
-        std::copy(bmds.begin(), bmds.end(), visited.begin());
-        std::vector<mer_t> indeg0;
-        std::vector<mer_t> paths(mer_op_type::nb_mers, 1); // 1 for itself as a k-mer.
+        // Every node is pushed at most once on indeg0, it never grows past
+        // its reserved size.
+        visited = bmds;
+        auto& indeg0 = m_indeg0;
+        auto& paths = m_paths;
+        indeg0.clear();
+        std::fill(paths.begin(), paths.end(), 1); // 1 for itself as a k-mer.
         mer_t longest = 0;
 
         for(const auto fm : fms) {
             for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
-                assert2(visited[mer_op_type::lc(fm, b)] == yes, "Invalid F-move, missing left companion " << fm << ' ' << b);
+                assert2(visited.is_yes(mer_op_type::lc(fm, b)), "Invalid F-move, missing left companion " << fm << ' ' << b);
                 const auto nm = mer_op_type::nmer(fm, b);
-                if(visited[nm] != yes)
+                if(!visited.is_yes(nm))
                     indeg0.push_back(nm);
             }
         }
@@ -48,7 +82,7 @@ struct longest_path_type {
 
             for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
                 const auto nm = mer_op_type::nmer(m, b);
-                if(visited[nm] == yes) continue;
+                if(visited.is_yes(nm)) continue;
                 const auto len = std::max(paths[nm], (mer_t)(paths[m] + 1));
                 paths[nm] = len;
                 longest = std::max(longest, len);
@@ -57,50 +91,126 @@ struct longest_path_type {
             }
         }
 
-        if(std::any_of(visited.begin(), visited.end(), [](tristate_t x) { return x != yes; }))
+        if(!visited.all_yes())
             return mer_op_type::nb_mers;
 
         return longest;
     }
 
-    mer_t longest_path(const std::vector<mer_t>& mds) {
-        std::vector<tristate_t> bmds;
-        std::vector<mer_t> fms;
+    // Same result as longest_path(bmds, fms), multi-threaded. The nodes
+    // (not in bmds) are processed by frontiers: a node is in the frontier of
+    // level l if the longest path ending at it has l nodes. m_remaining[fm]
+    // is the number of left companions of fm not yet processed (nor in
+    // bmds). The thread processing the last one puts the right companions,
+    // the successors, in the next frontier.
+    mer_t parallel_longest_path(const bmds_t& bmds, const std::vector<mer_t>& fms) {
+        constexpr mer_t sentinel = 0; // Homopolymer, never in a frontier
+
+        for(mer_t fm = 0; fm < mer_op_type::nb_fmoves; ++fm) {
+            uint8_t count = 0;
+            for(mer_t b = 0; b < mer_op_type::alpha; ++b)
+                count += !bmds.is_yes(mer_op_type::lc(fm, b));
+            m_remaining[fm].store(count, std::memory_order_relaxed);
+        }
+        m_queue->clear();
+        for(const auto fm : fms) {
+            assert2(m_remaining[fm] == 0, "Invalid F-move, missing left companion " << fm);
+            for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
+                const auto nm = mer_op_type::nmer(fm, b);
+                if(!bmds.is_yes(nm))
+                    m_queue->push(nm);
+            }
+        }
+        m_queue->swap();
+        for(auto& c : m_processed)
+            c.count = 0;
+
+        m_pool->set_work([&](int th) {
+            std::pair<mer_t*, ssize_t> push_loc{nullptr, 0};
+            ssize_t push_index = 0;
+            size_t processed = 0;
 
-        mds_op_type<mer_op_type>::from_mds_fms(mds, bmds, fms);
-        return longest_path(bmds, fms);
+            while(true) {
+                const auto slice = m_queue->multi_pop();
+                if(slice.second <= 0) break; // Finished the current level
+
+                // Slice of length slice.second or ends with the sentinel
+                for(ssize_t i = 0; i < slice.second && slice.first[i] != sentinel; ++i) {
+                    const mer_t m = slice.first[i];
+                    ++processed;
+                    if(m_remaining[mer_op_type::fmove(m)].fetch_sub(1, std::memory_order_relaxed) != 1)
+                        continue;
+                    for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
+                        const auto nm = mer_op_type::nmer(m, b);
+                        if(bmds.is_yes(nm)) continue;
+                        if(push_index >= push_loc.second) {
+                            push_loc = m_queue->multi_push();
+                            push_index = 0;
+                        }
+                        push_loc.first[push_index++] = nm;
+                    }
+                }
+            }
+
+            // Pad unfilled location with the sentinel
+            if(push_loc.first && push_index < push_loc.second)
+                push_loc.first[push_index] = sentinel;
+            m_processed[th].count += processed;
+        });
+
+        mer_t levels = 0;
+        while(!m_queue->current_empty()) {
+            ++levels;
+            m_pool->start();
+            m_queue->swap();
+        }
+
+        size_t processed = bmds.count_yes();
+        for(const auto& c : m_processed)
+            processed += c.count;
+        if(processed != mer_op_type::nb_mers) // Some nodes on a cycle
+            return mer_op_type::nb_mers;
+
+        // As longest_path(): paths of 1 node are not counted
+        return levels > 1 ? levels : 0;
+    }
+
+    mer_t longest_path(const std::vector<mer_t>& mds) {
+        mds_op_type<mer_op_type>::from_mds_fms(mds, m_bmds, m_fms);
+        return longest_path(m_bmds, m_fms);
     }
 
 
-    mer_t shortest_path(const std::vector<tristate_t>& bmds, const std::vector<mer_t>& fms) {
+    mer_t shortest_path(const bmds_t& bmds, const std::vector<mer_t>& fms) {
         // Because it is a DAG, do a BFS. Start from every F-move and traverse
         // the DAG until encountering right-companions (an RF-move). Mark
         // visited nodes with nil, to differenciate from nodes in the MDS.
-        assert2(bmds.size() == visited.size(), "Wrong bmds input bmds size");
-        std::copy(bmds.begin(), bmds.end(), visited.begin());
-        std::queue<std::pair<mer_t, mer_t>> queue; // Elements are mer, path length
+        // A node is queued only once, when marked nil, so the queue is a
+        // flat array of nb_mers elements: m_bfs[head, tail).
+        visited = bmds;
+        size_t head = 0, tail = 0; // Elements are mer, path length
         for(auto fm : fms) {
             for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
                 const auto nm = mer_op_type::nmer(fm, b);
-                queue.emplace(nm, 1);
+                m_bfs[tail++] = std::make_pair(nm, (mer_t)1);
                 visited[nm] = nil;
             }
         }
 
-        while(!queue.empty()) {
-            const auto elt = queue.front();
-            queue.pop();
+        while(head < tail) {
+            const auto elt = m_bfs[head++];
 
             unsigned int nb_rc = 0; // Number of right companion of elt in MDS
             for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
                 const auto nm = mer_op_type::nmer(elt.first, b);
-                if(visited[nm] == yes) {
+                if(visited.is_yes(nm)) {
                     ++nb_rc;
                     continue;
                 } else if(visited[nm] == nil) {
                     continue;
                 }
-                queue.emplace(nm, elt.second + 1);
+                assert2(tail < m_bfs.size(), "BFS queue overflow");
+                m_bfs[tail++] = std::make_pair(nm, (mer_t)(elt.second + 1));
                 visited[nm] = nil;
             }
             if(nb_rc == mer_op_type::alpha) // End of path, it is the shortest
@@ -110,5 +220,235 @@ struct longest_path_type {
         assert2(false, "No RF-move found. Not an MDS");
         return 0;
     }
+
+protected:
+    // Scratch space of longest_path() and shortest_path()
+    std::vector<mer_t> m_paths;
+    std::vector<mer_t> m_indeg0;
+    std::vector<std::pair<mer_t, mer_t>> m_bfs;
+    bmds_t m_bmds;
+    std::vector<mer_t> m_fms;
+
+    struct alignas(64) thread_count {
+        size_t count = 0;
+    };
+    std::vector<std::atomic<uint8_t>> m_remaining;
+    std::unique_ptr<mt_queue<mer_t>> m_queue;
+    std::vector<thread_count> m_processed;
+    std::unique_ptr<simple_thread_pool<std::function<void(int)>>> m_pool;
+};
+
+// Longest remaining path maintained through F-moves and RF-moves, in time
+// proportional to the part of the graph whose depth changes. The depth of a
+// node not in the MDS is the number of nodes of the longest path ending at it
+// (0 for the nodes in the MDS), and the longest remaining path is the largest
+// depth (counted in a histogram of the depths).
+//
+// After an F-move, the left companions leave the MDS and their successors,
+// the right companions, enter it. So the left companions become sinks, and
+// the right companions were sources. The depths can only decrease, downstream
+// of the right companions. Symmetrically after an RF-move, the right
+// companions become sources and the depths can only increase. The changed
+// nodes are processed by increasing old depth, which is a topological order,
+// and the propagation stops at the nodes whose depth does not change.
+template<typename mer_op_type>
+struct incremental_longest_path_type {
+    typedef typename mer_op_type::mer_t mer_t;
+    typedef mds_op_type<mer_op_type> mds_ops;
+    typedef tristate_vector<mer_op_type> bmds_t;
+
+    bmds_t bmds;
+
+    incremental_longest_path_type()
+        : m_depth(mer_op_type::nb_mers, 0)
+        , m_histo(mer_op_type::nb_mers + 1, 0)
+        , m_stamp(mer_op_type::nb_mers, 0)
+        , m_round(0)
+        , m_max(0)
+        , m_valid(false)
+        {}
+
+    // Same as longest_path_type::longest_path(bmds, fms), and initialize the
+    // depths for the following moves.
+    mer_t init(const bmds_t& nbmds, const std::vector<mer_t>& fms) {
+        bmds = nbmds;
+        std::fill(m_depth.begin(), m_depth.end(), 0);
+        std::fill(m_histo.begin(), m_histo.end(), 0);
+        m_max = 0;
+
+        m_list.clear();
+        for(const auto fm : fms) {
+            for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
+                assert2(bmds.is_yes(mer_op_type::lc(fm, b)), "Invalid F-move, missing left companion " << fm << ' ' << b);
+                const auto nm = mer_op_type::nmer(fm, b);
+                if(!bmds.is_yes(nm)) {
+                    m_depth[nm] = 1;
+                    m_list.push_back(nm);
+                }
+            }
+        }
+
+        // Peel the DAG as longest_path_type::longest_path(). m_stamp marks the
+        // processed nodes.
+        new_round();
+        size_t processed = bmds.count_yes();
+        while(!m_list.empty()) {
+            const auto m = m_list.back();
+            m_list.pop_back();
+            m_stamp[m] = m_round;
+            ++processed;
+            add_depth(m_depth[m]);
+
+            bool has_fm = true;
+            for(mer_t b = 0; has_fm && b < mer_op_type::alpha; ++b) {
+                const auto lm = mer_op_type::lc(m, b);
+                has_fm = bmds.is_yes(lm) || m_stamp[lm] == m_round;
+            }
+            for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
+                const auto nm = mer_op_type::nmer(m, b);
+                if(bmds.is_yes(nm)) continue;
+                m_depth[nm] = std::max(m_depth[nm], (mer_t)(m_depth[m] + 1));
+                if(has_fm)
+                    m_list.push_back(nm);
+            }
+        }
+        m_valid = processed == mer_op_type::nb_mers;
+        return longest();
+    }
+
+    // Longest remaining path, nb_mers if there is a cycle
+    mer_t longest() const {
+        if(!m_valid) return mer_op_type::nb_mers;
+        return m_max > 1 ? m_max : 0;
+    }
+
+    // Do F-move fm in bmds and return the new longest remaining path
+    mer_t do_fmove(mer_t fm) {
+        if(!m_valid) {
+            mds_ops::do_fmove(fm, bmds);
+            return reinit();
+        }
+
+        mer_t lcs[mer_op_type::alpha];
+        unsigned nb_lcs = 0;
+        for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
+            const auto m = mer_op_type::lc(fm, b);
+            if(mer_op_type::nmer(m) != m) // Not a homopolymer, leaving the MDS
+                lcs[nb_lcs++] = m;
+        }
+        mds_ops::do_fmove(fm, bmds);
+
+        // The left companions are done last, once the depths of their
+        // predecessors are final.
+        new_round();
+        for(unsigned i = 0; i < nb_lcs; ++i)
+            m_stamp[lcs[i]] = m_round;
+        for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
+            const auto m = mer_op_type::nmer(fm, b);
+            if(m_depth[m] == 0) continue; // Homopolymer, already in the MDS
+            remove_depth(m_depth[m]);
+            m_depth[m] = 0;
+            schedule_successors(m);
+        }
+        propagate();
+
+        for(unsigned i = 0; i < nb_lcs; ++i) { // New sinks
+            m_depth[lcs[i]] = depth_from_preds(lcs[i]);
+            add_depth(m_depth[lcs[i]]);
+        }
+        return longest();
+    }
+
+    // Do RF-move rfm in bmds and return the new longest remaining path
+    mer_t do_rfmove(mer_t rfm) {
+        if(!m_valid) {
+            mds_ops::do_rfmove(rfm, bmds);
+            return reinit();
+        }
+
+        mds_ops::do_rfmove(rfm, bmds);
+        new_round();
+        for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
+            const auto m = mer_op_type::pmer(mer_op_type::rc(rfm * mer_op_type::alpha, b));
+            if(!bmds.is_yes(m) || m_depth[m] == 0) continue;
+            remove_depth(m_depth[m]); // Was a sink, now in the MDS
+            m_depth[m] = 0;
+        }
+        for(mer_t b = 0; b < mer_op_type::alpha; ++b) { // New sources
+            const auto m = mer_op_type::rc(rfm * mer_op_type::alpha, b);
+            if(bmds.is_yes(m)) continue; // Homopolymer
+            m_depth[m] = 1;
+            add_depth(1);
+            schedule_successors(m);
+        }
+        propagate();
+        return longest();
+    }
+
+protected:
+    std::vector<mer_t> m_depth;
+    std::vector<mer_t> m_histo; // Number of nodes with a given depth
+    std::vector<uint32_t> m_stamp;
+    uint32_t m_round;
+    mer_t m_max;
+    bool m_valid; // Not valid if there is a cycle
+    std::vector<mer_t> m_list;
+    std::priority_queue<std::pair<mer_t, mer_t>, std::vector<std::pair<mer_t, mer_t>>, std::greater<std::pair<mer_t, mer_t>>> m_queue; // (old depth, mer)
+
+    // Start a new round of m_stamp. Clear m_stamp when m_round wraps around
+    inline void new_round() {
+        if(++m_round == 0) {
+            std::fill(m_stamp.begin(), m_stamp.end(), 0);
+            m_round = 1;
+        }
+    }
+
+    mer_t reinit() {
+        std::vector<mer_t> fms;
+        mds_ops::all_fmoves(bmds, fms);
+        const bmds_t nbmds(bmds);
+        return init(nbmds, fms);
+    }
+
+    inline void add_depth(mer_t d) {
+        ++m_histo[d];
+        m_max = std::max(m_max, d);
+    }
+
+    inline void remove_depth(mer_t d) {
+        --m_histo[d];
+        while(m_max > 0 && m_histo[m_max] == 0)
+            --m_max;
+    }
+
+    mer_t depth_from_preds(mer_t m) const {
+        mer_t d = 0;
+        for(mer_t b = 0; b < mer_op_type::alpha; ++b)
+            d = std::max(d, m_depth[mer_op_type::pmer(m, b)]);
+        return d + 1;
+    }
+
+    void schedule_successors(mer_t m) {
+        for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
+            const auto nm = mer_op_type::nmer(m, b);
+            if(bmds.is_yes(nm) || m_stamp[nm] == m_round) continue;
+            m_stamp[nm] = m_round;
+            m_queue.emplace(m_depth[nm], nm);
+        }
+    }
+
+    void propagate() {
+        while(!m_queue.empty()) {
+            const auto m = m_queue.top().second;
+            m_queue.pop();
+            const auto d = depth_from_preds(m);
+            if(d == m_depth[m]) continue;
+            remove_depth(m_depth[m]);
+            m_depth[m] = d;
+            add_depth(d);
+            schedule_successors(m);
+        }
+    }
 };
+
 #endif // LONGEST_PATH_H_
@@ -0,0 +1,80 @@
+#include "argparse.hpp"
+#include <iostream>
+#include <chrono>
+#include <new>
+#include <cstdlib>
+
+#ifndef K
+    #error Must define k-mer length K
+#endif
+
+#ifndef ALPHA
+    #error Must define alphabet length ALPHA
+#endif
+
+#include "mer_op.hpp"
+#include "mds_op.hpp"
+#include "misc.hpp"
+#include "longest_path.hpp"
+
+// Count the memory allocations. (GCC does not see that free() matches this
+// operator new once inlined.)
+static size_t nb_allocs = 0;
+void* operator new(size_t size) {
+    ++nb_allocs;
+    if(void* ptr = std::malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+#pragma GCC diagnostic pop
+
+typedef mer_op_type<K, ALPHA> mer_ops;
+typedef mer_ops::mer_t mer_t;
+typedef mds_op_type<mer_ops> mds_ops;
+
+struct LongestPathBenchArgs : argparse::Args {
+    std::optional<const char*>& mds_arg = kwarg("f,mds", "File with MDS");
+    uint64_t& iteration_arg = kwarg("iteration", "Number of calls of each function").set_default(1000);
+    std::vector<const char*>& comp_arg = arg("component").set_default("");
+
+    void welcome() override {
+        std::cout <<
+            "Benchmark of the longest and shortest remaining paths\n\n"
+            "Output, for each function, the number of memory allocations and time per call"
+            << std::endl;
+    }
+};
+
+// Number of allocations and time (in us) per call of fn
+template<typename F>
+void bench(const char* name, uint64_t iterations, F fn) {
+    size_t sum = fn(); // Warm up
+    const size_t start_allocs = nb_allocs;
+    const auto start = std::chrono::steady_clock::now();
+    for(uint64_t i = 0; i < iterations; ++i)
+        sum += fn();
+    const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << ' ' << (double)(nb_allocs - start_allocs) / iterations
+              << ' ' << elapsed.count() / iterations << ' ' << sum << '\n';
+}
+
+int main(int argc, char* argv[]) {
+    const auto args = argparse::parse<LongestPathBenchArgs>(argc, argv);
+    const uint64_t iterations = std::max((uint64_t)1, args.iteration_arg);
+
+    const auto mds = args.mds_arg ? mds_from_file<mer_t>(*args.mds_arg) : mds_from_arg<mer_t>(args.comp_arg);
+    mds_ops::bmds_t bmds;
+    std::vector<mer_t> fms;
+    mds_ops::from_mds_fms(mds, bmds, fms);
+
+    longest_path_type<mer_ops> lp;
+    std::cout << "function allocs/call us/call sum\n";
+    bench("longest_path(bmds,fms)", iterations, [&]() { return lp.longest_path(bmds, fms); });
+    bench("shortest_path", iterations, [&]() { return lp.shortest_path(bmds, fms); });
+    bench("longest_path(mds)", iterations, [&]() { return lp.longest_path(mds); });
+
+    return EXIT_SUCCESS;
+}
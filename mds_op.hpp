@@ -5,11 +5,13 @@
 #include <set>
 #include <algorithm>
 #include <numeric>
+#include <bit>
 
 #include "dbg.hpp"
 #include "mer_op.hpp"
 #include "imove_signature.hpp"
 #include "common.hpp"
+#include "tristate_vector.hpp"
 
 template<typename mer_op_type>
 struct mds_op_type {
@@ -17,39 +19,44 @@ struct mds_op_type {
     typedef typename mer_op_type::mer_t mer_t;
     typedef imove_type<mer_op_type> imove_t;
     typedef typename imove_t::mask_type mask_t;
+    typedef tristate_vector<mer_op_type> bmds_t;
 
-    std::vector<tristate_t> bmds, nbmds;
+    bmds_t bmds, nbmds;
     std::vector<bool> done;
     std::vector<mer_t> fmoves, nfmoves, fm_listA;
 
     mds_op_type()
-    : bmds(mer_op_t::nb_mers)
-    , nbmds(mer_op_t::nb_mers)
-    , done(mer_op_t::nb_fmoves)
+    : done(mer_op_t::nb_fmoves)
     , fmoves(mer_op_t::nb_fmoves)
     , nfmoves(mer_op_t::nb_fmoves)
     {}
 
-    static bool has_fm(const std::vector<tristate_t> mds, mer_t fm) {
+    static constexpr uint64_t group_mask() {
+        uint64_t res = 0;
+        for(unsigned i = 0; i < 64; i += mer_op_t::alpha)
+            res |= (uint64_t)1 << i;
+        return res;
+    }
+
+    static bool has_fm(const bmds_t& mds, mer_t fm) {
         for(mer_t b = 0; b < mer_op_t::alpha; ++b) {
-            if(mds[mer_op_t::lc(fm, b)] != yes)
+            if(!mds.is_yes(mer_op_t::lc(fm, b)))
                 return false;
         }
         return true;
     }
 
-    static bool has_rfm(const std::vector<tristate_t> mds, mer_t rfm) {
+    static bool has_rfm(const bmds_t& mds, mer_t rfm) {
         rfm *= mer_op_t::alpha;
         for(mer_t b = 0; b < mer_op_t::alpha; ++b) {
-            if(mds[mer_op_t::rc(rfm, b)] != yes)
+            if(!mds.is_yes(mer_op_t::rc(rfm, b)))
                 return false;
         }
         return true;
     }
 
-    static void from_mds_fms(const std::vector<mer_t>& mds, std::vector<tristate_t>& bmds, std::vector<mer_t>& fms) {
-        bmds.resize(mer_op_t::nb_mers);
-        std::fill(bmds.begin(), bmds.end(), no);
+    static void from_mds_fms(const std::vector<mer_t>& mds, bmds_t& bmds, std::vector<mer_t>& fms) {
+        bmds.fill(no);
         fms.clear();
 
         for(auto m : mds) {
@@ -61,17 +68,53 @@ struct mds_op_type {
 
     }
 
-    static void from_bmds_fms(const std::vector<tristate_t>& bmds, std::vector<mer_t>& fms) {
+    static void from_bmds_fms(const bmds_t& bmds, std::vector<mer_t>& fms) {
+        all_fmoves(bmds, fms);
+    }
+
+    // All the F-moves of bmds, in increasing order. The left companions
+    // lc(fm, b) = fm + b * nb_fmoves are, for each base b, a range of
+    // nb_fmoves consecutive mers: AND the alpha ranges of the yes bitset, 64
+    // F-moves at a time.
+    static void all_fmoves(const bmds_t& bmds, std::vector<mer_t>& fms) {
         fms.clear();
-        for(mer_t fm = 0; fm < mer_op_t::nb_fmoves; ++fm) {
-            if(has_fm(bmds, fm))
-                fms.push_back(fm);
+        const auto& set = bmds.yes_set();
+        for(size_t i = 0; i < mer_op_t::nb_fmoves; i += 64) {
+            uint64_t w = ~(uint64_t)0;
+            for(mer_t b = 0; b < mer_op_t::alpha; ++b)
+                w &= set.word_at(i + b * mer_op_t::nb_fmoves);
+            if(mer_op_t::nb_fmoves - i < 64)
+                w &= ((uint64_t)1 << (mer_op_t::nb_fmoves - i)) - 1;
+            for( ; w; w &= w - 1)
+                fms.push_back(i + std::countr_zero(w));
+        }
+    }
+
+    // All the RF-moves of bmds, in increasing order. The right companions
+    // rc(rfm * alpha, b) are alpha consecutive mers. If alpha divides 64,
+    // these groups do not straddle words and are tested 64 / alpha at a time.
+    static void all_rfmoves(const bmds_t& bmds, std::vector<mer_t>& rfms) {
+        rfms.clear();
+        if constexpr (64 % mer_op_t::alpha == 0) {
+            constexpr uint64_t first = group_mask(); // First bit of every group
+            const auto& words = bmds.yes_set().words;
+            for(size_t i = 0; i < words.size(); ++i) {
+                uint64_t w = words[i];
+                for(mer_t b = 1; b < mer_op_t::alpha; ++b)
+                    w &= words[i] >> b;
+                for(w &= first; w; w &= w - 1)
+                    rfms.push_back((i * 64 + std::countr_zero(w)) / mer_op_t::alpha);
+            }
+        } else {
+            for(mer_t rfm = 0; rfm < mer_op_t::nb_fmoves; ++rfm) {
+                if(has_rfm(bmds, rfm))
+                    rfms.push_back(rfm);
+            }
         }
     }
 
-    static void from_mds_rfms(const std::vector<mer_t>& mds, std::vector<tristate_t>& bmds, std::vector<mer_t>& rfms) {
-        bmds.resize(mer_op_t::nb_mers);
-        std::fill(bmds.begin(), bmds.end(), no);
+    static void from_mds_rfms(const std::vector<mer_t>& mds, bmds_t& bmds, std::vector<mer_t>& rfms) {
+        bmds.fill(no);
         rfms.clear();
 
         for(auto m : mds) {
@@ -85,7 +128,7 @@ struct mds_op_type {
     // Given an MDS, fill bmds as a 1-hot vector representing mds and fill
     // fmoves as the equivalent order list of F-moves
     void mds2fmoves(const std::vector<mer_t>& mds) {
-        std::fill(bmds.begin(), bmds.end(), nil);
+        bmds.fill(nil);
         std::fill(done.begin(), done.end(), false);
         std::vector<mer_t> fms;
         for(auto m : mds) {
@@ -116,14 +159,14 @@ struct mds_op_type {
     }
 
     void fmoves2mds(const std::vector<mer_t>& fms) {
-        std::fill(bmds.begin(), bmds.end(), nil);
+        bmds.fill(nil);
 
         for(const auto fm : fms)
             do_fmove(fm, bmds);
     }
 
 
-    static void do_fmove(mer_t fm, std::vector<tristate_t>& bmds) {
+    static void do_fmove(mer_t fm, bmds_t& bmds) {
         //assert2(mer_op_t::nb_mers == std::accumulate(bmds.cbegin(), bmds.cend(), 0, [](mer_t a, tristate_t x) { return a + (x == yes); }), "Too few mers in bmds");
         for(mer_t b = 0; b < mer_op_t::alpha; ++b) {
             const auto m = mer_op_t::lc(fm, b);
@@ -135,7 +178,7 @@ struct mds_op_type {
         // assert2(mer_op_t::nb_mers == std::accumulate(bmds.cbegin(), bmds.cend(), 0, [](mer_t a, tristate_t x) { return a + (x == yes); }), "Too few mers in bmds");
     }
 
-    static void do_rfmove(mer_t rfm, std::vector<tristate_t>& bmds) {
+    static void do_rfmove(mer_t rfm, bmds_t& bmds) {
         rfm *= mer_op_t::alpha;
         for(mer_t b = 0; b < mer_op_t::alpha; ++b) {
             const auto m = mer_op_t::rc(rfm, b);
@@ -165,8 +208,8 @@ struct mds_op_type {
     // in the component after traversing the I-move. nfmoves is a valid ordered
     // list of FMs in that new component as well.
     void traverse_imove(const imove_t& imove) {
-        std::fill(bmds.begin(), bmds.end(), nil);
-        std::fill(nbmds.begin(), nbmds.end(), nil);
+        bmds.fill(nil);
+        nbmds.fill(nil);
         fm_listA.clear();
         nfmoves.clear();
         std::set<mer_t> targets;
@@ -194,7 +237,7 @@ struct mds_op_type {
             bool touch_nbmds = false;
             for(mer_t b = 0; !touch_nbmds && b < mer_op_t::alpha; ++b) {
                 const mer_t m = mer_op_t::lc(nfm, b);
-                touch_nbmds = nbmds[m] == yes && !mer_op_t::is_homopolymer(m);
+                touch_nbmds = nbmds.is_yes(m) && !mer_op_t::is_homopolymer(m);
             }
             if(touch_nbmds) {
                 nfmoves.push_back(nfm);
@@ -203,7 +246,7 @@ struct mds_op_type {
                 fm_listA.push_back(nfm);
                 do_fmove(nfm, bmds);
                 for(auto it = targets.cbegin(); it != targets.cend(); ) {
-                    if(bmds[*it] == yes) {
+                    if(bmds.is_yes(*it)) {
                         auto cit = it; // Have to copy first as .erase will invalidate the iterator
                         ++it;
                         targets.erase(cit);
@@ -237,7 +280,7 @@ struct mds_op_type {
 #ifndef NDEBUG
         bool has_fmove = true;
         for(mer_t b = 0; b < mer_op_t::alpha; ++b) {
-            has_fmove = has_fmove && (nbmds[mer_op_t::lc(imove.fm, b)] == yes);
+            has_fmove = has_fmove && nbmds.is_yes(mer_op_t::lc(imove.fm, b));
         }
         assert2(has_fmove, "fm should be doable in new component " << imove.fm);
 #endif
@@ -0,0 +1,111 @@
+#ifndef MER_SET_H_
+#define MER_SET_H_
+
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include <memory>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+
+#include "misc.hpp"
+
+// Dense set of mers: one bit per mer. Only for mer spaces that fit in memory
+// (ak_bits <= max_bits).
+template<typename mer_ops>
+struct mer_bitset {
+	typedef typename mer_ops::mer_t mer_t;
+	std::vector<uint64_t> words;
+
+	mer_bitset() : words(((size_t)mer_ops::nb_mers + 63) / 64, 0) {}
+
+	inline bool test(mer_t m) const { return (words[(size_t)m / 64] >> ((size_t)m % 64)) & 1; }
+	inline void set(mer_t m) { words[(size_t)m / 64] |= (uint64_t)1 << ((size_t)m % 64); }
+	inline void reset(mer_t m) { words[(size_t)m / 64] &= ~((uint64_t)1 << ((size_t)m % 64)); }
+
+	// The 64 bits starting at bit i, which need not be aligned (bits past the
+	// end are 0)
+	inline uint64_t word_at(size_t i) const {
+		const size_t w = i / 64, s = i % 64;
+		uint64_t res = words[w] >> s;
+		if(s != 0 && w + 1 < words.size())
+			res |= words[w + 1] << (64 - s);
+		return res;
+	}
+
+	size_t count() const {
+		size_t res = 0;
+		for(const auto w : words)
+			res += std::popcount(w);
+		return res;
+	}
+};
+
+// Read only set of mers with fast membership test. The representation is
+// chosen given the size of the set and of the mer space:
+//  - a bitset (mer_bitset) if the mer space is small enough, or if the set is
+//    dense enough that the bitset is not much bigger than the set itself,
+//  - a sorted vector (binary search) for small sets,
+//  - a hash set otherwise.
+template<typename mer_ops>
+struct mer_set_type {
+	typedef typename mer_ops::mer_t mer_t;
+	enum kind_type { bitset, sorted, hash };
+
+	static constexpr size_t bitset_max_bytes = (size_t)1 << 26; // Always use a bitset if smaller
+	static constexpr size_t sorted_max_size = 4096;
+
+	mer_set_type(std::vector<mer_t>&& mers) {
+		std::sort(mers.begin(), mers.end());
+		mers.erase(std::unique(mers.begin(), mers.end()), mers.end());
+		m_size = mers.size();
+
+		if constexpr (mer_ops::ak_bits <= mer_ops::max_bits) {
+			const size_t bitset_bytes = ((size_t)mer_ops::nb_mers + 7) / 8;
+			if(bitset_bytes <= std::max(bitset_max_bytes, 4 * m_size * sizeof(mer_t))) {
+				m_kind = bitset;
+				m_bitset.reset(new mer_bitset<mer_ops>);
+				// Values out of range are not valid mers and are never
+				// queried (as with the hash set): drop them
+				for(auto it = mers.cbegin(); it != mers.cend() && *it < mer_ops::nb_mers; ++it)
+					m_bitset->set(*it);
+				return;
+			}
+		}
+		if(m_size <= sorted_max_size) {
+			m_kind = sorted;
+			m_sorted = std::move(mers);
+		} else {
+			m_kind = hash;
+			m_hash.reserve(m_size);
+			m_hash.insert(mers.cbegin(), mers.cend());
+		}
+	}
+
+	inline bool contains(mer_t m) const {
+		switch(m_kind) {
+		case bitset: return m_bitset->test(m);
+		case sorted: return std::binary_search(m_sorted.cbegin(), m_sorted.cend(), m);
+		default: return m_hash.find(m) != m_hash.cend();
+		}
+	}
+
+	size_t size() const { return m_size; }
+	kind_type kind() const { return m_kind; }
+
+protected:
+	kind_type m_kind;
+	size_t m_size;
+	std::unique_ptr<mer_bitset<mer_ops>> m_bitset;
+	std::vector<mer_t> m_sorted;
+	std::unordered_set<mer_t> m_hash;
+};
+
+// Load a set from a file and/or command line arguments (see get_mds)
+template<typename mer_ops>
+mer_set_type<mer_ops> get_mer_set(const char* path_mds, const std::vector<const char*>& args) {
+	return mer_set_type<mer_ops>(get_mds<std::vector<typename mer_ops::mer_t>>(path_mds, args));
+}
+
+#endif // MER_SET_H_
@@ -0,0 +1,62 @@
+#ifndef MER_STREAM_H_
+#define MER_STREAM_H_
+
+#include <vector>
+#include <cstddef>
+
+#include "sequence.hpp"
+
+// Rolling k-mers over a translated_block_stream. The bases are translated in
+// batches, and for each batch the k-mers ending at every base are computed,
+// both forward and reverse complemented. The k-mers do not span fasta records:
+// new_record() must be called at the beginning of every record.
+template<typename mer_ops>
+struct mer_stream {
+	typedef typename mer_ops::mer_t mer_t;
+	static constexpr size_t batch_size = 4096;
+
+	translated_block_stream& ts;
+	std::vector<char> bases;
+	std::vector<mer_t> mers, rc_mers; // Batch of k-mers and their reverse complement
+
+	mer_stream(translated_block_stream& s)
+		: ts(s)
+		, bases(batch_size)
+		, mers(batch_size)
+		, rc_mers(batch_size)
+		{ new_record(); }
+
+	void new_record() {
+		m_mer = m_rc_mer = 0;
+		m_len = 0;
+	}
+
+	// Fill mers and rc_mers with the next batch of k-mers of the current
+	// record. Returns the number of k-mers, 0 at the end of the record.
+	size_t next_batch() {
+		size_t nb = 0;
+		while(nb == 0) {
+			const size_t nb_bases = ts.read(bases.data(), batch_size);
+			if(nb_bases == 0) break;
+			for(size_t i = 0; i < nb_bases; ++i) {
+				const mer_t b = bases[i];
+				m_mer = mer_ops::nmer(m_mer, b);
+				m_rc_mer = mer_ops::pmer(m_rc_mer, mer_ops::alpha - 1 - b);
+				if(m_len + 1 < mer_ops::k) [[unlikely]] {
+					++m_len;
+					continue;
+				}
+				mers[nb] = m_mer;
+				rc_mers[nb] = m_rc_mer;
+				++nb;
+			}
+		}
+		return nb;
+	}
+
+protected:
+	mer_t m_mer, m_rc_mer;
+	unsigned m_len; // Number of bases in current mer (up to k - 1)
+};
+
+#endif // MER_STREAM_H_
@@ -5,6 +5,7 @@
 #include <complex>
 #include <cmath>
 #include <cstdint>
+#include <cstddef>
 #include <iostream>
 
 template<typename mer_ops>
@@ -55,6 +56,80 @@ struct root_unity_type {
 		 const auto npos = embed_mer(nmer, offset);
 		 return npos.imag() > epsilon && pos.imag() < -epsilon;
 	}
+
+	// Same as in_mykkeltveit_set, given an approximation pos of the embedding
+	// of m (e.g., from mykkeltveit_stream). The position of the successor is
+	// obtained by rotation of pos. If either is close to the x-axis, the
+	// answer is computed from scratch by in_mykkeltveit_set.
+	bool in_mykkeltveit_set(mer_t m, const complex& pos, uint32_t offset = 1) const {
+		const complex npos = pos * values[mer_ops::k - 1];
+		if(std::abs(pos.imag()) < guard || std::abs(npos.imag()) < guard)
+			return in_mykkeltveit_set(m, offset);
+		return npos.imag() > 0 && pos.imag() < 0;
+	}
+
+	// Error allowed on an approximate position
+	static constexpr double guard = 1e-6;
+};
+
+// Rolling embedding of the consecutive mers of a sequence. When a base b is
+// shifted in and a base d is shifted out, the position is updated in O(1):
+// pos' = w^-1 pos + (b - d) w^(offset-1), where w = exp(2i pi / k). The
+// reverse complement shifts the other way: pos' = w pos + (b - d) w^offset.
+// The rounding errors accumulated by the updates are bounded by recomputing
+// the positions from scratch every refresh mers. reset() must be called when
+// the mers are not consecutive (e.g., at the beginning of a record).
+template<typename mer_ops, bool track_rc = false>
+struct mykkeltveit_stream {
+	typedef typename root_unity_type<mer_ops>::complex complex;
+	typedef typename mer_ops::mer_t mer_t;
+	static constexpr unsigned refresh = 1024;
+
+	const root_unity_type<mer_ops>& roots;
+	const uint32_t offset;
+	const complex shift, rc_shift; // w^(offset-1) and w^offset
+
+	mykkeltveit_stream(const root_unity_type<mer_ops>& r, uint32_t offset = 1)
+		: roots(r)
+		, offset(offset)
+		, shift(r.values[(offset + mer_ops::k - 1) % mer_ops::k])
+		, rc_shift(r.values[offset % mer_ops::k])
+		{ reset(); }
+
+	void reset() { m_len = 0; }
+
+	// Add the next mer m (with reverse complement rc) of the sequence.
+	void push(mer_t m, mer_t rc) {
+		if(m_len % refresh == 0) {
+			m_pos = roots.embed_mer(m, offset);
+			if constexpr (track_rc)
+				m_rc_pos = roots.embed_mer(rc, offset);
+		} else {
+			const double b = (double)mer_ops::rb(m) - (double)mer_ops::lb(m_mer);
+			m_pos = m_pos * roots.values[mer_ops::k - 1] + b * shift;
+			if constexpr (track_rc) {
+				const double rc_b = (double)mer_ops::lb(rc) - (double)mer_ops::rb(m_rc);
+				m_rc_pos = m_rc_pos * roots.values[1] + rc_b * rc_shift;
+			}
+		}
+		m_mer = m;
+		m_rc = rc;
+		++m_len;
+	}
+
+	// Is the current mer, or its reverse complement, in the set
+	inline bool in_set() const { return roots.in_mykkeltveit_set(m_mer, m_pos, offset); }
+	inline bool rc_in_set() const {
+		static_assert(track_rc, "Reverse complement not tracked");
+		return roots.in_mykkeltveit_set(m_rc, m_rc_pos, offset);
+	}
+
+	const complex& pos() const { return m_pos; }
+
+protected:
+	mer_t   m_mer, m_rc;
+	complex m_pos, m_rc_pos;
+	size_t  m_len; // Number of mers pushed since reset
 };
 
 
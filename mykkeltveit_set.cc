@@ -27,6 +27,7 @@ struct MykkeltveiSetArgs : argparse::Args {
     bool& range_flag = flag("r,range", "Find range (smallest/largest longest path)");
     bool& longest_path_flag = flag("l,longest-path", "Compute longest path");
     bool& brute_flag = flag("brute", "Use brute force to create set");
+    uint32_t& threads_arg = kwarg("t,threads", "Number of threads to compute the longest paths").set_default(1);
 
     void welcome() override {
         std::cout <<
@@ -119,6 +120,7 @@ int main(int argc, char* argv[]) {
     }
 
     std::vector<mer_t> mds_sorted, min_mds, max_mds;
+    longest_path_type<mer_ops> lp(args.threads_arg);
     size_t min_lp = std::numeric_limits<size_t>::max(), max_lp = 0;
     bool done = false;
     while(!done) {
@@ -135,7 +137,6 @@ int main(int argc, char* argv[]) {
                 if(!args.range_flag)
                     std::cout << " -1"; // Not an MDS
             } else { // Is an MDS
-                longest_path_type<mer_ops> lp;
                 size_t mds_lp = lp.longest_path(mds);
                 if(!args.range_flag) {
                     std::cout << '\t' << mds_lp;
@@ -4,7 +4,6 @@
 #include <unordered_set>
 #include <random>
 #include <chrono>
-#include <bitset>
 #include <cstdlib>
 #include <csignal>
 #include <functional>
@@ -15,6 +14,7 @@
 #include "random_seed.hpp"
 #include "simple_thread_pool.hpp"
 #include "longest_path.hpp"
+#include "mer_set.hpp"
 
 
 #ifndef K
@@ -197,16 +197,12 @@ size_t union_size(const C& mers, const S& set) {
 template<typename mer_ops>
 struct quickset {
 	typedef amer_t value_type;
-	std::bitset<mer_ops::nb_mers>* _data;
-	quickset()
-	: _data(new std::bitset<mer_ops::nb_mers>)
-		{}
-	~quickset() { delete _data; }
+	mer_bitset<mer_ops> _data;
 
-	void set(const amer_t& x) { _data->set(x.val); }
-	void erase(const amer_t& x) { _data->reset(x.val); }
+	void set(const amer_t& x) { _data.set(x.val); }
+	void erase(const amer_t& x) { _data.reset(x.val); }
 
-	bool find(const amer_t& x) const { return _data->test(x.val); }
+	bool find(const amer_t& x) const { return _data.test(x.val); }
 	constexpr bool end() const { return false; }
 	constexpr bool cend() const { return false; }
 };
@@ -303,7 +299,7 @@ struct amain<mer_ops, true> {
 			std::ofstream out(*args.output_arg);
 			bool first = true;
 			for(mer_t i = 0; i < mer_ops::nb_mers; ++i) {
-				if(!mer_set._data->test(i)) continue;
+				if(!mer_set._data.test(i)) continue;
 				if(!first) {
 					out << ',';
 				} else {
@@ -323,7 +319,7 @@ struct amain<mer_ops, true> {
             longest_path lp;
 			std::vector<mer_t> path_mers;
 			for(mer_t i = 0; i < mer_ops::nb_mers; ++i) {
-				if(!mer_set._data->test(i)) continue;
+				if(!mer_set._data.test(i)) continue;
 				path_mers.push_back(mer_t(i));
 				path_mers.push_back(mer_ops::reverse_comp(mer_t(i)));
 			}
@@ -1,5 +1,7 @@
 #include <cstdlib>
 #include <random>
+#include <memory>
+#include <functional>
 #include <unistd.h>
 #include <signal.h>
 
@@ -17,6 +19,7 @@
 #include "imoves.hpp"
 #include "imove_signature.hpp"
 #include "longest_path.hpp"
+#include "simple_thread_pool.hpp"
 
 enum ArgsOperation { min, max };
 struct OptimizeRemPathLenArgs : argparse::Args {
@@ -25,6 +28,10 @@ struct OptimizeRemPathLenArgs : argparse::Args {
     ArgsOperation& op_arg = kwarg("op", "Operation to optimize for");
     bool& progress_flag = flag("p,progress", "Show progress");
     std::optional<const char*>& mds_arg = kwarg("f,mds", "File with MDS");
+    uint32_t& threads_arg = kwarg("t,threads", "Number of threads per replica to compute the I-moves").set_default(1);
+    uint32_t& replicas_arg = kwarg("r,replicas", "Number of replicas, each in its own thread").set_default(1);
+    double& temp_ratio_arg = kwarg("temp-ratio", "Ratio between the temperatures of consecutive replicas").set_default(2.0);
+    uint64_t& exchange_arg = kwarg("exchange", "Number of iterations between replica exchanges").set_default(10);
 
     std::vector<const char*>& comp_arg = arg("comp").set_default("");
 };
@@ -40,11 +47,11 @@ struct element {
     typedef mds_op_type<mer_op_type> mds_t;
 
     element()
-        : bmds(mer_op_t::nb_mers, no)
+        : bmds(no)
         { }
 
     mer_t path_len;
-    std::vector<tristate_t> bmds;
+    typename mds_t::bmds_t bmds;
     std::vector<mer_t> fms; // All f-moves equivalent to bmds
     std::vector<mer_t> fmoves; // possible f-moves
     imove_sig_t ims;
@@ -67,103 +74,75 @@ int catch_interrupts() {
     return 0;
 }
 
-bool less(mer_t x, mer_t y) { return x < y; }
-bool greater(mer_t x, mer_t y) { return x > y; }
-
-int main(int argc, char* argv[]) {
-    if(catch_interrupts() == -1) {
-        std::cerr << "Sigaction: " << strerror(errno) << std::endl;
-        return EXIT_FAILURE;
-    }
-
-    std::ios::sync_with_stdio(false);
-    const char* br = "\r";
-    const char* nl = "\33[0K";
-    if(!isatty(2)) {
-        br = "";
-        nl = "\n";
-    }
-
-
-    imoves_type<mer_ops> imoves_op;
-    mds_op_type<mer_ops> mds_op;
-    longest_path_type<mer_ops> longest_path;
-
-    std::mt19937_64 rand_gen((std::random_device())());
-    std::uniform_real_distribution<float> rand_unit(0.0, 1.0);
-
-    const auto args = argparse::parse<OptimizeRemPathLenArgs>(argc, argv);
-
-    // Comparator for operation
-    bool (*comp)(mer_t, mer_t);
-    switch(args.op_arg) {
-    case ArgsOperation::min:
-        comp = less;
-        break;
-    case ArgsOperation::max:
-        comp = greater;
-        break;
-    default:
-        std::cerr << "Unsuported operation" << std::endl;
-        exit(EXIT_FAILURE);
-    }
+// One chain of the simulated annealing, with its own scratch space, so the
+// replicas can run in parallel. Energy is the length of the remaining path
+// (negated to maximize). T starts at temp_init and is updated by T_{n+1} =
+// \lambda*T_n. DE = E_{new} - E_{current}. Probability of acceptence is 1 if
+// DE < 0 and exp(-DE/T) if DE >= 0.
+template<typename mer_op_type>
+struct replica_type {
+    typedef typename mer_op_type::mer_t mer_t;
+    typedef element<mer_op_type> element_t;
 
-    element<mer_ops> current, best;
+    mds_op_type<mer_op_type> mds_op;
+    parallel_imoves_type<mer_op_type> imoves_op;
+    incremental_longest_path_type<mer_op_type> inc_longest_path;
+    std::mt19937_64 rand_gen;
+    std::uniform_real_distribution<float> rand_unit;
     std::vector<mer_t> fms;
 
-    const auto start(args.mds_arg ? mds_from_file<mer_t>(*args.mds_arg) : mds_from_arg<mer_t>(args.comp_arg));
-    mds_op.from_mds_fms(start, current.bmds, current.fms);
-    mds_op.mds2fmoves(start);
-    current.fmoves = mds_op.fmoves;
-    current.path_len = longest_path.longest_path(current.bmds, current.fms);
-    current.ims = imoves_op.imoves(start);
-    best = current;
-    const auto start_len = best.path_len;
-
-    // Do simulated annealing. Energy is length of remaining path. T starts at 1
-    // and updated by T_{n+1} = \lambda*T_n. DE = E_{new} - E_{current}.
-    // Probability of acceptence is 1 if DE < 0 and exp(-DE/T))/2 if DE >= 0.
-    const double temp_init = (double)start_len / 14.0;
-    double temp = temp_init;
+    const bool minimize;
+    const double temp_init;
+    double temp;
+    element_t current, best;
+    uint64_t no_update = 0; // Nb iteration with no improvement
+    static constexpr uint64_t no_update_max = 20; // Max number of iteration with no update
+    static constexpr uint64_t no_update_temp = 2 * no_update_max; // Reset temperature if no update
 
+    replica_type(unsigned threads, const element_t& start, bool min, double temp, uint64_t seed)
+        : imoves_op(threads)
+        , rand_gen(seed)
+        , rand_unit(0.0, 1.0)
+        , minimize(min)
+        , temp_init(temp)
+        , temp(temp)
+        , current(start)
+        , best(start)
+        {}
 
-    uint64_t no_update = 0; // Nb iteration with no improvement
-    const uint64_t no_update_max = 20; // Max number of iteration with no update
-    const uint64_t no_update_temp = 2 * no_update_max; // Reset temperature if no update
+    double energy(mer_t len) const { return minimize ? (double)len : -(double)len; }
+    bool better(mer_t x, mer_t y) const { return energy(x) < energy(y); }
 
     // Do one step of I-move and lower temperature. Within each of this steps,
     // do at most 2*K F-moves without lowering the temperature.
-    for(uint64_t iteration = 0; !interrupt && iteration < args.iteration_arg; ++iteration, temp *= args.lambda_arg) {
-        if(args.progress_flag)
-            std::cerr << br << iteration << ' ' << temp  << ' ' << (uint64_t)best.path_len << ' ' << (uint64_t)current.path_len << ' ' << (uint64_t)start_len << nl << std::flush;
+    void step(double lambda) {
         std::uniform_int_distribution<int> rand_im(0, current.ims.size() - 1);
         const auto im = current.ims[rand_im(rand_gen)];
         mds_op.fromFmoves((const std::vector<mer_t>&)current.fmoves);
         mds_op.traverse_imove(im);
         mds_op.from_bmds_fms(mds_op.nbmds, fms);
 
-        mer_t nlp = longest_path.longest_path(mds_op.nbmds, fms);
-        // std::cout << "im " << im << ' ' << nlp << " | " << current.bmds << " | " << mds_op.nbmds << std::endl;
-        // Do a some numbers of F-move to find a low longest path within the
-        // component
-        for(unsigned int fmi = 0; fmi < 2 * mer_ops::k; ++fmi) {
+        mer_t nlp = inc_longest_path.init(mds_op.nbmds, fms);
+        // Do a some numbers of F-move to find a better longest path within
+        // the component
+        for(unsigned int fmi = 0; fmi < 2 * mer_op_type::k; ++fmi) {
             const mer_t fm = mds_op.nfmoves[fmi];
             mds_op.do_fmove(fm, mds_op.nbmds);
             fms.erase(std::find(fms.begin(), fms.end(), fm));
-            for(mer_t b = 0; b < mer_ops::alpha; ++b) {
-                mer_t nfm = mer_ops::fmove(mer_ops::nmer(fm, b));
+            for(mer_t b = 0; b < mer_op_type::alpha; ++b) {
+                mer_t nfm = mer_op_type::fmove(mer_op_type::nmer(fm, b));
                 if(mds_op.has_fm(mds_op.nbmds, nfm))
                    fms.push_back(nfm);
             }
-            mer_t nnlp = longest_path.longest_path(mds_op.nbmds, fms);
-            nlp = std::min(nlp, nnlp);
+            const mer_t nnlp = inc_longest_path.do_fmove(fm);
+            if(better(nnlp, nlp))
+                nlp = nnlp;
         }
 
-        const auto threshold = std::exp((float)(nlp - current.path_len) / temp);
+        const double de = energy(nlp) - energy(current.path_len);
         const auto randnb = rand_unit(rand_gen);
-        // std::cout << "nlp " << (uint64_t)nlp << " current " << (uint64_t)current.path_len << " threshold " << threshold << " rand " << randnb << std::endl;
-        if(nlp >= current.path_len && randnb > threshold) {
-            if(++no_update > no_update_max && !comp(current.path_len, best.path_len)) {
+        if(de >= 0 && randnb > std::exp(-de / temp)) {
+            if(++no_update > no_update_max && !better(current.path_len, best.path_len)) {
                 current = best;
                 no_update = 0;
             }
@@ -171,8 +150,8 @@ int main(int argc, char* argv[]) {
                 temp = temp_init;
                 no_update =0;
             }
-
-            continue;
+            temp *= lambda;
+            return;
         }
 
         // Update current
@@ -183,9 +162,107 @@ int main(int argc, char* argv[]) {
         current.ims = imoves_op.imoves(current.bmds);
         no_update = 0;
 
-        if(comp(current.path_len, best.path_len))
+        if(better(current.path_len, best.path_len))
             best = current;
+        temp *= lambda;
+    }
+};
+typedef replica_type<mer_ops> replica_t;
+
+int main(int argc, char* argv[]) {
+    if(catch_interrupts() == -1) {
+        std::cerr << "Sigaction: " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ios::sync_with_stdio(false);
+    const char* br = "\r";
+    const char* nl = "\33[0K";
+    if(!isatty(2)) {
+        br = "";
+        nl = "\n";
+    }
+
+    std::random_device rand_dev;
+    std::mt19937_64 rand_gen(rand_dev());
+    std::uniform_real_distribution<float> rand_unit(0.0, 1.0);
+
+    const auto args = argparse::parse<OptimizeRemPathLenArgs>(argc, argv);
+    const unsigned nb_replicas = std::max(1u, args.replicas_arg);
+    const uint64_t exchange = std::max((uint64_t)1, args.exchange_arg);
+
+    bool minimize;
+    switch(args.op_arg) {
+    case ArgsOperation::min:
+        minimize = true;
+        break;
+    case ArgsOperation::max:
+        minimize = false;
+        break;
+    default:
+        std::cerr << "Unsuported operation" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    element<mer_ops> start_elt;
+    {
+        mds_op_type<mer_ops> mds_op;
+        parallel_imoves_type<mer_ops> imoves_op(args.threads_arg);
+        longest_path_type<mer_ops> longest_path(args.threads_arg);
+
+        const auto start(args.mds_arg ? mds_from_file<mer_t>(*args.mds_arg) : mds_from_arg<mer_t>(args.comp_arg));
+        mds_op.from_mds_fms(start, start_elt.bmds, start_elt.fms);
+        mds_op.mds2fmoves(start);
+        start_elt.fmoves = mds_op.fmoves;
+        start_elt.path_len = longest_path.longest_path(start_elt.bmds, start_elt.fms);
+        start_elt.ims = imoves_op.imoves(start);
+    }
+    const auto start_len = start_elt.path_len;
+
+    // Parallel tempering: replica r starts at temperature temp_init *
+    // temp_ratio^r. Every exchange iterations, the states of 2 neighboring
+    // replicas (even or odd pairs, alternatively) are swapped with
+    // probability min(1, exp((1/T_r - 1/T_{r+1}) * (E_r - E_{r+1}))).
+    const double temp_init = (double)start_len / 14.0;
+    std::vector<std::unique_ptr<replica_t>> replicas;
+    for(unsigned r = 0; r < nb_replicas; ++r)
+        replicas.emplace_back(new replica_t(args.threads_arg, start_elt, minimize, temp_init * std::pow(args.temp_ratio_arg, r), rand_dev()));
+    element<mer_ops> best = start_elt; // Best over all replicas, gathered after each round
+    std::unique_ptr<simple_thread_pool<std::function<void(int)>>> pool(nb_replicas > 1 ? new simple_thread_pool<std::function<void(int)>>(nb_replicas) : nullptr);
+
+    for(uint64_t iteration = 0, round = 0; !interrupt && iteration < args.iteration_arg; ++round) {
+        if(args.progress_flag)
+            std::cerr << br << iteration << ' ' << replicas[0]->temp  << ' ' << (uint64_t)best.path_len << ' ' << (uint64_t)replicas[0]->current.path_len << ' ' << (uint64_t)start_len << nl << std::flush;
+        const uint64_t steps = std::min(exchange, args.iteration_arg - iteration);
+        auto work = [&](int th) {
+            for(uint64_t i = 0; !interrupt && i < steps; ++i)
+                replicas[th]->step(args.lambda_arg);
+        };
+        if(pool) {
+            pool->set_work(work);
+            pool->start();
+        } else {
+            work(0);
+        }
+        iteration += steps;
+
+        for(unsigned r = 0; r < nb_replicas; ++r) {
+            if(replicas[0]->better(replicas[r]->best.path_len, best.path_len))
+                best = replicas[r]->best;
+        }
+
+        for(unsigned r = round % 2; r + 1 < nb_replicas; r += 2) {
+            auto& ra = *replicas[r];
+            auto& rb = *replicas[r + 1];
+            const double delta = (1.0 / ra.temp - 1.0 / rb.temp) * (ra.energy(ra.current.path_len) - rb.energy(rb.current.path_len));
+            if(delta >= 0 || rand_unit(rand_gen) < std::exp(delta)) {
+                std::swap(ra.current, rb.current);
+                ra.no_update = rb.no_update = 0;
+            }
+        }
     }
+    if(pool)
+        pool->stop();
     if(args.progress_flag)
         std::cerr << std::endl;
     // std::cout << '\n' << (uint64_t)best.path_len << ' ' << (uint64_t) start_len << std::endl;
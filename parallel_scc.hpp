@@ -0,0 +1,246 @@
+#ifndef PARALLEL_SCC_H_
+#define PARALLEL_SCC_H_
+
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#include "simple_thread_pool.hpp"
+
+// Multi-threaded strongly connected components of the de Bruijn graph minus a
+// set. Gives the same counts as tarjan_scc::scc_counts: a single node is an
+// SCC only if it has a self loop (homopolymer).
+//
+// The algorithm works in rounds on the remaining nodes:
+//  - trim: nodes without a remaining predecessor or successor are not on a
+//    cycle and are removed, iteratively,
+//  - coloring: every node gets the largest id of the nodes reaching it
+//    (forward propagation until a fixpoint),
+//  - backward: each root (node whose color is its own id) collects its SCC,
+//    i.e., the nodes of the same color which reach it.
+// The SCCs found are removed and the next round starts on the remaining nodes.
+template<typename mer_ops>
+struct parallel_scc {
+	typedef typename mer_ops::mer_t mer_t;
+	static constexpr size_t chunk_size = (size_t)1 << 16;
+	enum : uint8_t { alive = 0, removed = 1 };
+
+	const unsigned nb_threads;
+	std::vector<std::atomic<uint8_t>> state;
+	std::vector<std::atomic<uint8_t>> in_deg, out_deg; // Degree in remaining graph
+	std::vector<std::atomic<mer_t>> color; // Allocated by scc_counts only
+
+	parallel_scc(unsigned threads)
+		: nb_threads(std::max(1u, threads))
+		, state(mer_ops::nb_mers)
+		, in_deg(mer_ops::nb_mers)
+		, out_deg(mer_ops::nb_mers)
+		, m_thread_counts(nb_threads)
+		, m_pool(nb_threads)
+		{}
+
+	~parallel_scc() { m_pool.stop(); }
+
+	static void noprogress(mer_t components, mer_t in_components, mer_t remaining) { }
+
+	// Number of SCCs and number of mers in SCCs of the de Bruijn graph minus
+	// the set given by the indicator function `fn` (which must be thread
+	// safe). `progress(components, in_components, remaining)` is called after
+	// every round.
+	template<typename Fn, typename P>
+	std::pair<mer_t, mer_t> scc_counts(Fn fn, P progress) {
+		if(color.size() != mer_ops::nb_mers)
+			color = std::vector<std::atomic<mer_t>>(mer_ops::nb_mers);
+		remove_set(fn);
+
+		mer_t components = 0, in_components = 0;
+		while(true) {
+			const mer_t remaining = trim();
+			progress(components, in_components, remaining);
+			if(remaining == 0) break;
+			propagate_colors();
+			const auto counts = collect_sccs();
+			components += counts.first;
+			in_components += counts.second;
+		}
+		return std::make_pair(components, in_components);
+	}
+
+	template<typename Fn>
+	inline std::pair<mer_t, mer_t> scc_counts(Fn fn) { return scc_counts(fn, noprogress); }
+
+	// Number of nodes left after peeling, repeatedly, the nodes without
+	// predecessor or successor from the de Bruijn graph minus the set. It is 0
+	// if and only if the set is decycling. Much cheaper than scc_counts: the
+	// remaining nodes are on cycles or on paths between cycles.
+	template<typename Fn>
+	mer_t residual(Fn fn) {
+		remove_set(fn);
+		return trim();
+	}
+
+protected:
+	struct alignas(64) thread_counts {
+		mer_t first = 0, second = 0;
+		std::vector<mer_t> stack;
+	};
+	std::vector<thread_counts> m_thread_counts;
+	simple_thread_pool<std::function<void(int)>> m_pool;
+	std::atomic<size_t> m_next_chunk;
+
+	inline bool is_alive(mer_t m) const { return state[m].load(std::memory_order_relaxed) == alive; }
+
+	// Kill a node, true if it was alive
+	inline bool kill(mer_t m) {
+		uint8_t expected = alive;
+		return state[m].compare_exchange_strong(expected, removed, std::memory_order_relaxed);
+	}
+
+	template<typename Fn>
+	void remove_set(Fn fn) {
+		for_nodes([&](mer_t m, unsigned th) {
+			state[m].store(fn(m) ? removed : alive, std::memory_order_relaxed);
+		});
+	}
+
+	// Run fn(m, thread) over all the nodes, by chunks. In decreasing order if
+	// descending is true.
+	template<bool descending = false, typename F>
+	void for_nodes(F fn) {
+		constexpr size_t nb_chunks = ((size_t)mer_ops::nb_mers + chunk_size - 1) / chunk_size;
+		m_next_chunk = 0;
+		m_pool.set_work([&](int th) {
+			for(size_t i = m_next_chunk++; i < nb_chunks; i = m_next_chunk++) {
+				const size_t c = descending ? nb_chunks - 1 - i : i;
+				const mer_t start = c * chunk_size;
+				const mer_t end = std::min((size_t)mer_ops::nb_mers, (c + 1) * chunk_size);
+				if constexpr (descending) {
+					for(mer_t m = end; m > start; --m)
+						fn(m - 1, th);
+				} else {
+					for(mer_t m = start; m < end; ++m)
+						fn(m, th);
+				}
+			}
+		});
+		m_pool.start();
+	}
+
+	// Remove nodes not on a cycle. Returns the number of remaining nodes.
+	mer_t trim() {
+		for_nodes([&](mer_t m, unsigned th) {
+			uint8_t in = 0, out = 0;
+			if(is_alive(m)) {
+				for(unsigned b = 0; b < mer_ops::alpha; ++b) {
+					in += is_alive(mer_ops::pmer(m, b));
+					out += is_alive(mer_ops::nmer(m, b));
+				}
+			}
+			in_deg[m].store(in, std::memory_order_relaxed);
+			out_deg[m].store(out, std::memory_order_relaxed);
+		});
+
+		for_nodes([&](mer_t m, unsigned th) {
+			if(!is_alive(m)) return;
+			if(in_deg[m].load(std::memory_order_relaxed) > 0 && out_deg[m].load(std::memory_order_relaxed) > 0) return;
+			if(!kill(m)) return;
+			auto& stack = m_thread_counts[th].stack;
+			stack.push_back(m);
+			while(!stack.empty()) {
+				const mer_t u = stack.back();
+				stack.pop_back();
+				for(unsigned b = 0; b < mer_ops::alpha; ++b) {
+					const mer_t n = mer_ops::nmer(u, b);
+					if(n != u && is_alive(n) && in_deg[n].fetch_sub(1, std::memory_order_relaxed) == 1 && kill(n))
+						stack.push_back(n);
+					const mer_t p = mer_ops::pmer(u, b);
+					if(p != u && is_alive(p) && out_deg[p].fetch_sub(1, std::memory_order_relaxed) == 1 && kill(p))
+						stack.push_back(p);
+				}
+			}
+		});
+
+		for(auto& c : m_thread_counts)
+			c.first = 0;
+		for_nodes([&](mer_t m, unsigned th) { m_thread_counts[th].first += is_alive(m); });
+		mer_t remaining = 0;
+		for(const auto& c : m_thread_counts)
+			remaining += c.first;
+		return remaining;
+	}
+
+	// Color every node with the largest id of the nodes reaching it. The
+	// propagation starts from the largest ids, so most nodes get their final
+	// color at the first visit.
+	void propagate_colors() {
+		for_nodes([&](mer_t m, unsigned th) {
+			color[m].store(m, std::memory_order_relaxed);
+		});
+
+		for_nodes<true>([&](mer_t m, unsigned th) {
+			// Skip if not alive or already colored by a larger node: it has
+			// been propagated by that node.
+			if(!is_alive(m) || color[m].load(std::memory_order_relaxed) != m) return;
+			auto& stack = m_thread_counts[th].stack;
+			stack.push_back(m);
+			while(!stack.empty()) {
+				const mer_t u = stack.back();
+				stack.pop_back();
+				const mer_t c = color[u].load(std::memory_order_relaxed);
+				for(unsigned b = 0; b < mer_ops::alpha; ++b) {
+					const mer_t n = mer_ops::nmer(u, b);
+					if(!is_alive(n)) continue;
+					mer_t cur = color[n].load(std::memory_order_relaxed);
+					while(cur < c && !color[n].compare_exchange_weak(cur, c, std::memory_order_relaxed)) ;
+					if(cur < c)
+						stack.push_back(n);
+				}
+			}
+		});
+	}
+
+	// Collect and remove the SCC of every root. Returns the number of SCCs and
+	// the number of nodes in them.
+	std::pair<mer_t, mer_t> collect_sccs() {
+		for(auto& c : m_thread_counts)
+			c.first = c.second = 0;
+
+		for_nodes([&](mer_t m, unsigned th) {
+			if(!is_alive(m) || color[m].load(std::memory_order_relaxed) != m) return;
+			// Only this thread visits the nodes of color m
+			auto& counts = m_thread_counts[th];
+			mer_t size = 0;
+			state[m].store(removed, std::memory_order_relaxed);
+			counts.stack.push_back(m);
+			while(!counts.stack.empty()) {
+				const mer_t u = counts.stack.back();
+				counts.stack.pop_back();
+				++size;
+				for(unsigned b = 0; b < mer_ops::alpha; ++b) {
+					const mer_t p = mer_ops::pmer(u, b);
+					if(is_alive(p) && color[p].load(std::memory_order_relaxed) == m) {
+						state[p].store(removed, std::memory_order_relaxed);
+						counts.stack.push_back(p);
+					}
+				}
+			}
+			if(size > 1 || mer_ops::is_homopolymer(m)) {
+				++counts.first;
+				counts.second += size;
+			}
+		});
+
+		std::pair<mer_t, mer_t> res(0, 0);
+		for(const auto& c : m_thread_counts) {
+			res.first += c.first;
+			res.second += c.second;
+		}
+		return res;
+	}
+};
+
+#endif // PARALLEL_SCC_H_
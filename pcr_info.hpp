@@ -7,6 +7,7 @@
 
 #include "mer_op.hpp"
 #include "common.hpp"
+#include "tristate_vector.hpp"
 
 template<typename mer_op_type>
 struct pcr_info_type {
@@ -63,12 +64,12 @@ struct pcr_info_type {
         return true;
     }
 
-    bool check_bmds(const std::vector<tristate_t>& bmds) {
+    bool check_bmds(const tristate_vector<mer_op_t>& bmds) {
         std::vector<bool> used_pcrs(pcrs.size(), false);
         if(bmds.size() != mer_op_t::nb_mers) return false;
         mer_t count = 0;
         for(mer_t m = 0; m < mer_op_t::nb_mers; ++m) {
-            if(bmds[m] != yes) continue;
+            if(!bmds.is_yes(m)) continue;
             ++count;
             const auto pcr = mer2pcr[m];
             if(used_pcrs[pcr]) return false;
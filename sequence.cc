@@ -3,14 +3,22 @@
 #include <cstring>
 #include <sstream>
 #include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-void translated_stream::initialize_table(const char* str, unsigned size) {
-	const auto str_len = strlen(str);
+// Fill translation table with the alphabet str: str[i] is translated to i. If
+// str is empty, the alphabet is the digits '0' to '0' + size - 1.
+template<typename T>
+static void fill_table(std::vector<T>& table, const char* str, unsigned size) {
+	const auto str_len = str ? strlen(str) : 0;
 	if(str_len == 0) {
 		for(unsigned i = 0; i < size; ++i)
 			table['0' + i] = i;
 	} else if(str_len == size) {
-		for(unsigned i = 0; i < strlen(str); ++i) {
+		for(unsigned i = 0; i < str_len; ++i) {
 			if(!std::isprint(str[i]) || std::isspace(str[i]))
 				throw std::runtime_error("Invalid character in alphabet");
 			table[str[i]] = i;
@@ -20,6 +28,10 @@ void translated_stream::initialize_table(const char* str, unsigned size) {
 	}
 }
 
+void translated_stream::initialize_table(const char* str, unsigned size) {
+	fill_table(table, str, size);
+}
+
 translated_stream& translated_stream::header() {
 	m_seq_name.clear();
 	if(is.peek() == '>') {
@@ -51,3 +63,136 @@ translated_stream& translated_stream::operator>>(char& c) {
 	}
 	return *this;
 }
+
+translated_block_stream::translated_block_stream(const char* str, unsigned size, std::istream& i)
+	: table(256, invalid)
+	, asize(size)
+	, is(&i)
+	, offset(0)
+	, m_buffer(buffer_size)
+	, m_ptr(m_buffer.data())
+	, m_end(m_buffer.data())
+{ initialize_table(str, size); }
+
+translated_block_stream::translated_block_stream(const char* str, unsigned size, const char* begin, const char* end)
+	: table(256, invalid)
+	, asize(size)
+	, is(nullptr)
+	, offset(0)
+	, m_ptr(begin)
+	, m_end(end)
+{ initialize_table(str, size); }
+
+void translated_block_stream::initialize_table(const char* str, unsigned size) {
+	for(int c = 0; c < 256; ++c) {
+		if(std::isspace(c))
+			table[c] = space;
+	}
+	table['>'] = record;
+	fill_table(table, str, size);
+}
+
+bool translated_block_stream::refill() {
+	if(!is || !is->good()) return false;
+	is->read(m_buffer.data(), m_buffer.size());
+	m_ptr = m_buffer.data();
+	m_end = m_ptr + is->gcount();
+	return m_ptr < m_end;
+}
+
+size_t translated_block_stream::read(char* out, size_t len) {
+	size_t n = 0;
+	while(n < len) {
+		if(m_ptr == m_end && !refill()) break;
+
+		const char* ptr = m_ptr;
+		for( ; ptr < m_end && n < len; ++ptr) {
+			const int8_t c = table[(unsigned char)*ptr];
+			if(c >= 0) [[likely]] {
+				out[n++] = c;
+			} else if(c == record) {
+				m_ptr = ptr;
+				offset += n;
+				return n;
+			} else if(c == invalid) [[unlikely]] {
+				std::ostringstream msg;
+				msg << "Invalid character '" << *ptr << "' at position " << (offset + n + 1);
+				throw std::runtime_error(msg.str());
+			}
+			// else space, skip
+		}
+		m_ptr = ptr;
+	}
+	offset += n;
+	return n;
+}
+
+translated_block_stream& translated_block_stream::header() {
+	m_seq_name.clear();
+	if((m_ptr < m_end || refill()) && *m_ptr == '>') {
+		++m_ptr;
+		while(m_ptr < m_end || refill()) {
+			const char* nl = (const char*)memchr(m_ptr, '\n', m_end - m_ptr);
+			if(nl) {
+				m_seq_name.append(m_ptr, nl);
+				m_ptr = nl + 1;
+				break;
+			}
+			m_seq_name.append(m_ptr, m_end);
+			m_ptr = m_end;
+		}
+	}
+	return *this;
+}
+
+mapped_file::mapped_file(const char* path)
+	: m_base(nullptr)
+	, m_size(0)
+{
+	const int fd = open(path, O_RDONLY);
+	if(fd == -1)
+		throw std::runtime_error(std::string("Failed to open ") + path);
+	struct stat st;
+	if(fstat(fd, &st) == -1) {
+		close(fd);
+		throw std::runtime_error(std::string("Failed to stat ") + path);
+	}
+	m_size = st.st_size;
+	if(m_size > 0) {
+		void* base = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(base == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error(std::string("Failed to mmap ") + path);
+		}
+		madvise(base, m_size, MADV_WILLNEED);
+		m_base = (const char*)base;
+	}
+	close(fd);
+}
+
+mapped_file::~mapped_file() {
+	if(m_base)
+		munmap((void*)m_base, m_size);
+}
+
+std::vector<std::pair<const char*, const char*>> fasta_records(const char* begin, const char* end) {
+	std::vector<std::pair<const char*, const char*>> res;
+	// Skip the header line, which may contain a '>'
+	auto skip_line = [end](const char* ptr) -> const char* {
+		const char* nl = (const char*)memchr(ptr, '\n', end - ptr);
+		return nl ? nl + 1 : end;
+	};
+
+	if(begin == end) return res;
+	const char* start = begin;
+	const char* ptr = *begin == '>' ? skip_line(begin) : begin;
+	while(true) {
+		const char* next = (const char*)memchr(ptr, '>', end - ptr);
+		if(!next) break;
+		res.emplace_back(start, next);
+		start = next;
+		ptr = skip_line(next);
+	}
+	res.emplace_back(start, end);
+	return res;
+}
@@ -4,6 +4,8 @@
 #include <vector>
 #include <istream>
 #include <string>
+#include <utility>
+#include <cstdint>
 
 struct translated_stream {
 	std::vector<char> table;
@@ -30,5 +32,80 @@ protected:
 	std::string m_seq_name;
 };
 
+// Block based version of translated_stream. The input is read in large
+// buffers and translated a batch of bases at a time, rather than with one
+// formatted read per character. Reading stops at the beginning of the next
+// fasta record (a '>' character), which is then handled by header().
+//
+// The input is either a std::istream, or a range in memory (e.g., a record of
+// a mapped_file, see fasta_records()).
+struct translated_block_stream {
+	static constexpr size_t buffer_size = 1 << 20;
+
+	// Special values in the translation table (valid bases are >= 0). Signed
+	// whether or not char is.
+	static constexpr int8_t invalid = -1;
+	static constexpr int8_t space = -2;
+	static constexpr int8_t record = -3;
+
+	std::vector<int8_t> table;
+	const unsigned asize;
+	std::istream* const is; // nullptr when reading from memory
+	size_t offset; // Number of bases read so far
+
+	translated_block_stream(const char* str, unsigned size, std::istream& i);
+	translated_block_stream(const char* str, unsigned size, const char* begin = nullptr, const char* end = nullptr);
+
+	// Restart reading from memory range [begin, end)
+	void reset(const char* begin, const char* end) {
+		m_ptr = begin;
+		m_end = end;
+		offset = 0;
+	}
+
+	// True if there is still input to read
+	explicit operator bool() { return m_ptr < m_end || refill(); }
+
+	// Translate up to len bases into out. Returns the number of bases
+	// translated. A return value of 0 means the end of the current record (or
+	// of the input) has been reached.
+	size_t read(char* out, size_t len);
+
+	translated_block_stream& header(); // Process fasta header if any
+
+	const std::string& seq_name() const { return m_seq_name; }
+
+	// Reached end of input (rather than an error)
+	bool eof() const { return m_ptr == m_end && (!is || is->eof()); }
+
+protected:
+	void initialize_table(const char* str, unsigned size);
+	bool refill();
+	std::vector<char> m_buffer;
+	const char* m_ptr;
+	const char* m_end;
+	std::string m_seq_name;
+};
+
+// Read only memory map of a whole file.
+struct mapped_file {
+	mapped_file(const char* path);
+	~mapped_file();
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	const char* begin() const { return m_base; }
+	const char* end() const { return m_base + m_size; }
+	size_t size() const { return m_size; }
+
+protected:
+	const char* m_base;
+	size_t m_size;
+};
+
+// Boundaries of the records in a fasta file in memory. Every record but
+// possibly the first starts with a '>'. A file without any header is one
+// record.
+std::vector<std::pair<const char*, const char*>> fasta_records(const char* begin, const char* end);
 
 #endif // SEQUENCE_H_
@@ -5,10 +5,12 @@
 #include "argparse.hpp"
 #include <iostream>
 #include <iomanip>
-#include <unordered_set>
 #include <cassert>
 #include <cstddef>
 #include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include <tuple>
 
 #ifndef K
     #error Must define k-mer length K
@@ -19,7 +21,9 @@
 #endif
 
 #include "misc.hpp"
+#include "mer_set.hpp"
 #include "tarjan_scc.hpp"
+#include "parallel_scc.hpp"
 #include "mer_op.hpp"
 
 typedef mer_op_type<K, ALPHA> mer_ops;
@@ -31,6 +35,8 @@ struct SketchComponentsArgs : argparse::Args {
 	bool& canonical_flag = flag("c,canonical", "Use canonical k-mers");
 	bool& union_flag = flag("u,union", "Use union of set and reverse complemented set");
 	bool& progress_flag = flag("p,progress", "Display progress");
+	uint32_t& threads_arg = kwarg("t,threads", "Number of threads (parallel SCC if > 1)").set_default(1);
+	bool& acyclic_flag = flag("acyclic", "Only output number of mers left after peeling (0 iff decycling)");
 
 	std::vector<const char*>& sketch_arg = arg("k-mers").set_default("");
 
@@ -42,22 +48,24 @@ struct SketchComponentsArgs : argparse::Args {
 // Function checking if a mer is in the set of selecting mers.
 // typedef bool (*in_set_fn)(mer_t);
 
+typedef mer_set_type<mer_ops> mer_set_t;
+
 struct is_in_set {
-	const std::unordered_set<mer_t>& set;
-	is_in_set(const std::unordered_set<mer_t>& s) : set(s) {}
-	bool operator()(mer_t m) const { return set.find(m) != set.cend(); }
+	const mer_set_t& set;
+	is_in_set(const mer_set_t& s) : set(s) {}
+	bool operator()(mer_t m) const { return set.contains(m); }
 };
 
 struct can_is_in_set {
-	const std::unordered_set<mer_t>& set;
-	can_is_in_set(const std::unordered_set<mer_t>& s) : set(s) {}
-	bool operator()(mer_t m) const { return set.find(mer_ops::canonical(m)) != set.cend(); }
+	const mer_set_t& set;
+	can_is_in_set(const mer_set_t& s) : set(s) {}
+	bool operator()(mer_t m) const { return set.contains(mer_ops::canonical(m)); }
 };
 
 struct is_in_union {
-	const std::unordered_set<mer_t>& set;
-	is_in_union(const std::unordered_set<mer_t>& s) : set(s) {}
-	bool operator()(mer_t m) const { return set.find(m) != set.cend() || set.find(mer_ops::reverse_comp(m)) != set.cend(); }
+	const mer_set_t& set;
+	is_in_union(const mer_set_t& s) : set(s) {}
+	bool operator()(mer_t m) const { return set.contains(m) || set.contains(mer_ops::reverse_comp(m)); }
 };
 
 int main(int argc, char* argv[]) {
@@ -72,7 +80,7 @@ int main(int argc, char* argv[]) {
 		std::cerr << "Problem size too big" << std::endl;
 		return EXIT_FAILURE;
 	} else {
-		const auto mer_set = get_mds<std::unordered_set<mer_t>>(args.sketch_file_arg ? *args.sketch_file_arg : nullptr, args.sketch_arg);
+		const auto mer_set = get_mer_set<mer_ops>(args.sketch_file_arg ? *args.sketch_file_arg : nullptr, args.sketch_arg);
 
 		mer_t components = 0, in_components = 0, visited = 0;
 		size_t updates = 0;
@@ -94,16 +102,47 @@ int main(int argc, char* argv[]) {
 		auto new_visit = [&visited,&progress](mer_t m) { ++visited; progress(); };
 		// static_assert(std::is_integral<mer_t>::value, "mer_t is not integral");
 
-		tarjan_scc<mer_ops> comp_scc;
-		if(args.canonical_flag) {
-			const can_is_in_set can_fn(mer_set);
-			comp_scc.scc_iterate(can_fn, new_scc, new_node, new_visit);
-		} else if(args.union_flag) {
-			const is_in_union union_fn(mer_set);
-			comp_scc.scc_iterate(union_fn, new_scc, new_node, new_visit);
+		const unsigned nb_threads = std::max(1u, std::min(args.threads_arg, std::thread::hardware_concurrency()));
+		if(args.acyclic_flag) {
+			parallel_scc<mer_ops> peel(nb_threads);
+			mer_t residual;
+			if(args.canonical_flag)
+				residual = peel.residual(can_is_in_set(mer_set));
+			else if(args.union_flag)
+				residual = peel.residual(is_in_union(mer_set));
+			else
+				residual = peel.residual(is_in_set(mer_set));
+			std::cout << (size_t)residual << '\n';
+			return EXIT_SUCCESS;
+		} else if(nb_threads > 1) {
+			auto round_progress = [&](mer_t comps, mer_t in_comps, mer_t remaining) {
+				if(args.progress_flag)
+					std::cerr << '\r'
+							  << "comps " << std::setw(10) << comps
+							  << " in_comps " << std::setw(10) << in_comps
+							  << " remaining " << std::setw(10) << remaining
+							  << std::flush;
+			};
+			parallel_scc<mer_ops> comp_scc(nb_threads);
+			if(args.canonical_flag) {
+				std::tie(components, in_components) = comp_scc.scc_counts(can_is_in_set(mer_set), round_progress);
+			} else if(args.union_flag) {
+				std::tie(components, in_components) = comp_scc.scc_counts(is_in_union(mer_set), round_progress);
+			} else {
+				std::tie(components, in_components) = comp_scc.scc_counts(is_in_set(mer_set), round_progress);
+			}
 		} else {
-			const is_in_set set_fn(mer_set);
-			comp_scc.scc_iterate(set_fn, new_scc, new_node, new_visit);
+			tarjan_scc<mer_ops> comp_scc;
+			if(args.canonical_flag) {
+				const can_is_in_set can_fn(mer_set);
+				comp_scc.scc_iterate(can_fn, new_scc, new_node, new_visit);
+			} else if(args.union_flag) {
+				const is_in_union union_fn(mer_set);
+				comp_scc.scc_iterate(union_fn, new_scc, new_node, new_visit);
+			} else {
+				const is_in_set set_fn(mer_set);
+				comp_scc.scc_iterate(set_fn, new_scc, new_node, new_visit);
+			}
 		}
 
 		if(args.progress_flag)
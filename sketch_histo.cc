@@ -1,11 +1,15 @@
 #include <cstdlib>
-#include <unordered_set>
-#include <unordered_map>
 #include <functional>
 #include <vector>
 #include <algorithm>
 #include <random>
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <exception>
+#include <type_traits>
 
 #include "argparse.hpp"
 #include "misc.hpp"
@@ -13,6 +17,9 @@
 #include "permutations.hpp"
 #include "random_seed.hpp"
 #include "sequence.hpp"
+#include "mer_stream.hpp"
+#include "mer_set.hpp"
+#include "simple_thread_pool.hpp"
 #include "mykkeltveit.hpp"
 #include "champarnaud.hpp"
 #include "syncmer.hpp"
@@ -42,6 +49,8 @@ struct SketchHistoArgs : argparse::Args {
 	bool& union_flag = flag("u,union", "Use union of set and reverse complement set");
 	bool& sum_flag = flag("sum", "Output weighted sum of the histo");
 	uint32_t& hmin_arg = flag("hmin", "Ignore length of histo less than hmin").set_default(0);
+	std::optional<const char*>& input_arg = kwarg("input", "Sequence file (memory mapped, instead of stdin)");
+	uint32_t& threads_arg = kwarg("t,threads", "Number of threads to sketch records of --input").set_default(1);
 
 
 	std::vector<const char*>& sketch_arg = arg("sketch").set_default("");
@@ -50,7 +59,8 @@ struct SketchHistoArgs : argparse::Args {
 		std::cout <<
 			"Sketch a sequence given a context free / set scheme\n\n"
 			"Boils down to the intersection of k-mers in the set and in the sequence.\n"
-			"Sequence is read from stdin, set from -f or command line arguments."
+			"Sequence is read from stdin or --input, set from -f or command line arguments.\n"
+			"With --input, the records are sketched in parallel (-t) and output in order."
 			<< std::endl;
 	}
 };
@@ -59,56 +69,35 @@ typedef mer_op_type<K, ALPHA> mer_ops;
 typedef mer_ops::mer_t mer_t;
 
 
-bool straight_set(const std::unordered_set<mer_t>* set, mer_t m) {
-	return set->find(m) != set->end();
-}
-
-// struct memoized {
-// 	std::unordered_map<mer_t,bool> cache;
-// 	std::function<bool(mer_t)> f;
-// 	memoized(std::function<bool(mer_t)> f) : f(f) {}
-// 	bool operator()(mer_t m) {
-// 		auto it = cache.find(m);
-// 		if(it != cache.end())
-// 			return it->second;
-// 		const bool v = f(m);
-// 		cache.insert(it, std::make_pair(m, v));
-// 		return v;
-// 	}
-// };
+// Selection schemes. Each scheme is a functor telling whether a mer is
+// selected.
 
-bool memoized(std::unordered_map<mer_t,bool>* cache, std::function<bool(mer_t)> f, mer_t m) {
-	auto it = cache->find(m);
-	if(it != cache->end())
-		return it->second;
-	const bool v = f(m);
-	cache->insert(it, std::make_pair(m, v));
-	return v;
-}
-
-bool mykkeltveit(const root_unity_type<mer_ops>* root_unity, mer_t m) {
-	return root_unity->in_mykkeltveit_set(m);
-}
-// struct mykkeltveit {
-// 	const root_unity_type<mer_ops> root_unity;
+// Explicit set of mers
+struct set_scheme {
+	const mer_set_type<mer_ops> set;
+	set_scheme(mer_set_type<mer_ops>&& s) : set(std::move(s)) {}
+	inline bool operator()(mer_t m) const { return set.contains(m); }
+};
 
-// 	inline bool operator()(mer_t m) { return root_unity.in_mykkeltveit_set(m); }
-// };
+struct mykkeltveit_scheme {
+	const root_unity_type<mer_ops> root_unity;
+	inline bool operator()(mer_t m) const { return root_unity.in_mykkeltveit_set(m); }
+};
 
-struct champarnaud_data_type {
+struct champarnaud_scheme {
 	const index_t<mer_ops> index;
-	champarnaud_data_type() : index(mer_ops::k) {}
+	champarnaud_scheme() : index(mer_ops::k) {}
+	inline bool operator()(mer_t m) const { return index.in_champarnaud_set(m); }
 };
-inline bool champarnaud(const champarnaud_data_type* d, mer_t m) { return d->index.in_champarnaud_set(m); }
 
 // Syncmer when s is small (order on s-mer is an explicitely shuffled array)
-struct syncmer_data_type {
+struct syncmer_scheme {
 	const unsigned s, t;
 	const jflib::divisor64 div_s;
 	std::vector<mer_t> smer_order;
 
 	template<typename PRG>
-	syncmer_data_type(unsigned s, unsigned t, PRG* prg)
+	syncmer_scheme(unsigned s, unsigned t, PRG* prg)
 		: s(s)
 		, t(t)
 		, div_s(ipow((mer_t)mer_ops::alpha, (mer_t)s))
@@ -120,28 +109,34 @@ struct syncmer_data_type {
 				std::shuffle(smer_order.begin(), smer_order.end(), *prg);
 
 		}
+	inline bool operator()(mer_t m) const {
+		return min_smer<mer_ops>(m, s, smer_order, div_s) == t;
+	}
+
+	typedef smer_table_order<mer_t> order_type;
+	order_type order() const { return order_type(smer_order); }
 };
-inline bool syncmer(const syncmer_data_type* d, mer_t m) {
-	return min_smer<mer_ops>(m, d->s, d->smer_order, d->div_s) == d->t;
-}
 
 // Syncmer for large s (s-mer order using perm)
-struct syncmer_large_data_type {
-    const unsigned s, t;
+struct syncmer_large_scheme {
+	const unsigned s, t;
 	const jflib::divisor64 div_s;
-    const LubyRackofPermutation<mer_t> perm;
+	const LubyRackofPermutation<mer_t> perm;
 
 	template<typename PRG>
-	syncmer_large_data_type(unsigned s, unsigned t, PRG* prg)
+	syncmer_large_scheme(unsigned s, unsigned t, PRG* prg)
 	: s(s)
 	, t(t)
 	, div_s(ipow((mer_t)mer_ops::alpha, (mer_t)s))
 	, perm(*prg)
 	{ }
+	inline bool operator()(mer_t m) const {
+		return min_large_smer<mer_ops>(m, s, perm, div_s) == t;
+	}
+
+	typedef smer_perm_order<mer_t> order_type;
+	order_type order() const { return order_type(perm); }
 };
-inline bool syncmer_large(const syncmer_large_data_type* d, mer_t m) {
-	return min_large_smer<mer_ops>(m, d->s, d->perm, d->div_s) == d->t;
-}
 
 // struct frac_data_type {
 // 	typedef std::uniform_int_distribution<mer_t> mask_rng;
@@ -168,156 +163,298 @@ inline bool syncmer_large(const syncmer_large_data_type* d, mer_t m) {
 // 	return m < d->thresh;
 // }
 
-struct frac_data_type {
+struct frac_scheme {
   const LubyRackofPermutation<mer_t> perm;
   const mer_t thresh;
 
   template<typename PRG>
-  frac_data_type(double f, PRG& prg)
+  frac_scheme(double f, PRG& prg)
   : perm(prg)
   , thresh(std::round(std::pow(2.0, sizeof(mer_t) * 8) * f))
   { }
+
+  inline bool operator()(mer_t m) const {
+    const auto val = perm(m);
+    return  val < thresh;
+  }
 };
 
-inline bool frac(const frac_data_type* d, mer_t m) {
-  const auto val = d->perm(m);
-  return  val < d->thresh;
-}
+// Strand modes. Given a mer m and its reverse complement rc, query the
+// scheme.
+struct straight_strand {
+	template<typename F>
+	static inline bool select(F& f, mer_t m, mer_t) { return f(m); }
+};
 
-bool canonical_fn(std::function<bool(mer_t)> f, mer_t m) {
-	return f(mer_ops::canonical(m));
-}
+struct canonical_strand {
+	template<typename F>
+	static inline bool select(F& f, mer_t m, mer_t rc) { return f(std::min(m, rc)); }
+};
 
-bool union_fn(std::function<bool(mer_t)> f, mer_t m) {
-	return f(m) || f(mer_ops::canonical(m));
-}
+// f(m) || f(canonical(m)): reduces to f(m) when m is canonical
+struct union_strand {
+	template<typename F>
+	static inline bool select(F& f, mer_t m, mer_t rc) { return f(m) || (rc < m && f(rc)); }
+};
 
-double fill_in_histo(translated_stream& ts, std::vector<size_t>& histo, std::function<bool(mer_t)> lookup) {
-	std::fill(histo.begin(), histo.end(), 0);
-	uint64_t selected = 0, kmers = 0;
-	ts.header(); // Call at beginnin of every subsequence.
-	// std::cout << "Reading " << ts.seq_name() << std::endl;
-
-	mer_t mer = 0;
-	char inchar = '0';
-	size_t prev = 0;;
-	{ // Read first s-1 bases
-	  	size_t offset = 0;
-		for( ; offset + 1 < mer_ops::k && ts >> inchar; ++offset) {
-//			std::cout << "inchar " << (int)inchar << '\n';
-			if(inchar == mer_ops::alpha) return -1.0;
-			mer = mer_ops::nmer(mer, inchar);
-		}
+// Selection of a mer with a scheme and strand mode, resolved at compile
+// time. The specializations below hold a streaming state, hence one per
+// thread.
+template<typename Scheme, typename Strand>
+struct selector {
+	typedef Scheme scheme_type;
+	const Scheme& scheme;
+	selector(const Scheme& s) : scheme(s) {}
+	void new_record() {}
+	inline bool operator()(mer_t m, mer_t rc) { return Strand::select(scheme, m, rc); }
+};
+
+// Syncmer selection streams over the consecutive k-mers of the record rather
+// than querying every k-mer independently (see syncmer_stream).
+template<typename Scheme, typename Strand>
+struct syncmer_selector {
+	typedef Scheme scheme_type;
+	static constexpr bool track_rc = !std::is_same_v<Strand, straight_strand>;
+	const unsigned t;
+	syncmer_stream<mer_ops, typename Scheme::order_type, track_rc> stream;
+	syncmer_selector(const Scheme& s) : t(s.t), stream(s.order(), s.s) {}
+	void new_record() { stream.reset(); }
+	inline bool operator()(mer_t m, mer_t rc) {
+		stream.push(m, rc);
+		if constexpr (std::is_same_v<Strand, canonical_strand>)
+			return (m <= rc ? stream.min_smer() : stream.min_rc_smer()) == t;
+		else if constexpr (std::is_same_v<Strand, union_strand>)
+			return stream.min_smer() == t || (rc < m && stream.min_rc_smer() == t);
+		else
+			return stream.min_smer() == t;
+	}
+};
+
+template<typename Strand>
+struct selector<syncmer_scheme, Strand> : syncmer_selector<syncmer_scheme, Strand> {
+	using syncmer_selector<syncmer_scheme, Strand>::syncmer_selector;
+};
+
+template<typename Strand>
+struct selector<syncmer_large_scheme, Strand> : syncmer_selector<syncmer_large_scheme, Strand> {
+	using syncmer_selector<syncmer_large_scheme, Strand>::syncmer_selector;
+};
+
+// Champarnaud selection on the unpacked bases of the window (see
+// champarnaud_stream)
+template<typename Strand>
+struct selector<champarnaud_scheme, Strand> {
+	typedef champarnaud_scheme scheme_type;
+	static constexpr bool track_rc = !std::is_same_v<Strand, straight_strand>;
+	champarnaud_stream<mer_ops, track_rc> stream;
+	selector(const champarnaud_scheme& s) : stream(s.index) {}
+	void new_record() { stream.reset(); }
+	inline bool operator()(mer_t m, mer_t rc) {
+		stream.push(m, rc);
+		if constexpr (std::is_same_v<Strand, canonical_strand>)
+			return m <= rc ? stream.in_set() : stream.rc_in_set();
+		else if constexpr (std::is_same_v<Strand, union_strand>)
+			return stream.in_set() || (rc < m && stream.rc_in_set());
+		else
+			return stream.in_set();
+	}
+};
+
+// Mykkeltveit selection with a rolling embedding (see mykkeltveit_stream)
+template<typename Strand>
+struct selector<mykkeltveit_scheme, Strand> {
+	typedef mykkeltveit_scheme scheme_type;
+	static constexpr bool track_rc = !std::is_same_v<Strand, straight_strand>;
+	mykkeltveit_stream<mer_ops, track_rc> stream;
+	selector(const mykkeltveit_scheme& s) : stream(s.root_unity) {}
+	void new_record() { stream.reset(); }
+	inline bool operator()(mer_t m, mer_t rc) {
+		stream.push(m, rc);
+		if constexpr (std::is_same_v<Strand, canonical_strand>)
+			return m <= rc ? stream.in_set() : stream.rc_in_set();
+		else if constexpr (std::is_same_v<Strand, union_strand>)
+			return stream.in_set() || (rc < m && stream.rc_in_set());
+		else
+			return stream.in_set();
 	}
+};
 
-	size_t offset = 0;
-	while(ts >> inchar) {
-		++kmers;
-//		std::cout << "inchar " << (int)inchar << '\n';
-		if(inchar == mer_ops::alpha) return -1.0;
-		mer = mer_ops::nmer(mer, inchar);
-//		std::cout << "lookup" << std::endl;
-		if(lookup(mer)) {
+// Histogram of the distances between selected k-mers in one record of the
+// input. Returns the density of selected k-mers, -1 if the record has no
+// k-mer.
+template<typename Selector>
+double fill_in_histo(mer_stream<mer_ops>& ms, std::vector<size_t>& histo, Selector& selector) {
+	std::fill(histo.begin(), histo.end(), 0);
+	uint64_t selected = 0, kmers = 0;
+	ms.ts.header(); // Call at beginning of every subsequence.
+	ms.new_record();
+	selector.new_record();
+
+	size_t prev = 0, offset = 0;
+	for(size_t nb = ms.next_batch(); nb > 0; nb = ms.next_batch()) {
+		kmers += nb;
+		for(size_t i = 0; i < nb; ++i, ++offset) {
+			if(!selector(ms.mers[i], ms.rc_mers[i])) continue;
 			++selected;
-//			std::cout << "true" << std::endl;
 			const size_t dist = offset - prev;
 			if(dist >= histo.size())
 				histo.resize(dist + 1, 0);
 			++histo[dist];
 			prev = offset;
 		}
-//		std::cout << "after" << std::endl;
-		++offset;
 	}
 
-	return (double)selected / (double)kmers;
+	return kmers > 0 ? (double)selected / (double)kmers : -1.0;
+}
+
+void print_histo(std::ostream& os, const SketchHistoArgs& args, const std::string& seq_name, double density, const std::vector<size_t>& histo) {
+	if(!seq_name.empty())
+		os << '>' << seq_name << '\n';
+	os << "# density " << density << '\n';
+	if(args.sum_flag) {
+		size_t sum = 0;
+		for(size_t i = 0; i < histo.size(); ++i) {
+			if(histo[i] && i >= args.hmin_arg)
+				sum += i * histo[i];
+		}
+		os << sum << '\n';
+	} else {
+		for(size_t i = 0; i < histo.size(); ++i) {
+			if(histo[i] && i >= args.hmin_arg)
+				os << i << ' ' << histo[i] << '\n';
+		}
+	}
+}
+
+// Sketch the records of a memory mapped file. The records are processed by
+// chunks: the threads grab the next record of the chunk from an atomic
+// counter, and the output of the chunk is printed in the order of the input.
+template<typename Selector>
+void sketch_records(const SketchHistoArgs& args, const std::vector<std::pair<const char*, const char*>>& records,
+					unsigned nb_threads, const typename Selector::scheme_type& scheme) {
+	// Per thread state. The streaming state in the selector is not thread safe.
+	struct thread_state {
+		Selector selector;
+		translated_block_stream ts;
+		mer_stream<mer_ops> ms;
+		std::vector<size_t> histo;
+		thread_state(const char* alphabet, const typename Selector::scheme_type& scheme)
+			: selector(scheme)
+			, ts(alphabet, mer_ops::alpha)
+			, ms(ts)
+			{}
+	};
+	std::vector<std::unique_ptr<thread_state>> states;
+	for(unsigned i = 0; i < nb_threads; ++i)
+		states.emplace_back(new thread_state(args.alphabet_arg ? *args.alphabet_arg : nullptr, scheme));
+
+	const size_t chunk_size = 64 * nb_threads;
+	std::vector<std::string> outputs(chunk_size);
+	std::atomic<size_t> next;
+	size_t chunk_start = 0, chunk_end = 0;
+	std::exception_ptr error;
+	std::mutex error_mutex;
+
+	simple_thread_pool<std::function<void(int)>> pool(nb_threads);
+	pool.set_work([&](int th) {
+		auto& state = *states[th];
+		try {
+			for(size_t i = next++; i < chunk_end; i = next++) {
+				state.ts.reset(records[i].first, records[i].second);
+				const auto density = fill_in_histo(state.ms, state.histo, state.selector);
+				std::ostringstream os;
+				print_histo(os, args, state.ts.seq_name(), density, state.histo);
+				outputs[i - chunk_start] = std::move(os).str();
+			}
+		} catch(...) {
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if(!error) error = std::current_exception();
+		}
+	});
+
+	for( ; chunk_start < records.size(); chunk_start = chunk_end) {
+		chunk_end = std::min(records.size(), chunk_start + chunk_size);
+		next = chunk_start;
+		pool.start();
+		if(error) break;
+		for(size_t i = 0; i < chunk_end - chunk_start; ++i)
+			std::cout << outputs[i];
+	}
+	pool.stop();
+	if(error)
+		std::rethrow_exception(error);
+}
+
+template<typename Selector>
+int sketch(const SketchHistoArgs& args, const typename Selector::scheme_type& scheme) {
+	if(args.input_arg) {
+		const mapped_file input(*args.input_arg);
+		const auto records = fasta_records(input.begin(), input.end());
+		const unsigned nb_threads = std::max(1u, std::min(args.threads_arg, std::thread::hardware_concurrency()));
+		sketch_records<Selector>(args, records, nb_threads, scheme);
+		return EXIT_SUCCESS;
+	}
+
+	Selector selector(scheme);
+	std::vector<size_t> histo;
+	translated_block_stream ts(args.alphabet_arg ? *args.alphabet_arg : nullptr, mer_ops::alpha, std::cin);
+	mer_stream<mer_ops> ms(ts);
+
+	while(ts) {
+		const auto density = fill_in_histo(ms, histo, selector);
+		print_histo(std::cout, args, ts.seq_name(), density, histo);
+	}
+
+	if(!ts.eof()) {
+		std::cerr << "Encountered error reading sequence" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Resolve the strand mode
+template<typename Scheme>
+int sketch_strand(const SketchHistoArgs& args, const Scheme& scheme) {
+	if(args.canonical_flag)
+		return sketch<selector<Scheme, canonical_strand>>(args, scheme);
+	else if(args.union_flag)
+		return sketch<selector<Scheme, union_strand>>(args, scheme);
+	return sketch<selector<Scheme, straight_strand>>(args, scheme);
 }
 
 int main(int argc, char* argv[]) {
+	std::ios::sync_with_stdio(false);
 	const auto args = argparse::parse<SketchHistoArgs>(argc, argv);
 
-	std::vector<std::function<bool(mer_t)>> lookups; // Stack of lookup function. Composed with top of stack
-	lookups.reserve(10);
-
 	auto prg = seeded_prg<std::mt19937_64>(args.oseed_arg ? *args.oseed_arg : nullptr,
                                            args.iseed_arg ? *args.iseed_arg : nullptr);
 
-	// Bottom layer
-	std::unique_ptr<std::unordered_set<mer_t>> mer_set;
-	std::unordered_map<mer_t,bool> mer_set_cache;
-	std::unique_ptr<root_unity_type<mer_ops>> root_unity;
-	std::unique_ptr<syncmer_data_type> syncmer_data;
-	std::unique_ptr<syncmer_large_data_type> syncmer_large_data;
-	std::unique_ptr<frac_data_type> frac_data;
-	std::unique_ptr<champarnaud_data_type> champarnaud_data;
-
 	if(args.sketch_file_arg || !args.sketch_arg.empty()) {
-		mer_set.reset(new std::unordered_set<mer_t>);
-		*mer_set = get_mds<std::unordered_set<mer_t>>(*args.sketch_file_arg, args.sketch_arg);
-//	std::cout << "mer_set size " << mer_set.size() << ": " << joinT<size_t>(mer_set, ',') << '\n';
-		lookups.emplace_back(std::bind_front(straight_set, mer_set.get())); // Bottom layer is querying the set
+		const set_scheme scheme(get_mer_set<mer_ops>(args.sketch_file_arg ? *args.sketch_file_arg : nullptr, args.sketch_arg));
+		return sketch_strand(args, scheme);
 	} else if(args.mykkeltveit_flag) {
-		root_unity.reset(new root_unity_type<mer_ops>);
-		lookups.emplace_back(std::bind_front(mykkeltveit, root_unity.get()));
+		const mykkeltveit_scheme scheme;
+		return sketch_strand(args, scheme);
 	} else if(args.syncmer_arg) {
 		const unsigned s = args.syncmer_s_arg ? *args.syncmer_s_arg : K / 2 - 1;
 		if(std::pow(mer_ops::alpha, s) < 1e9) {
             std::cerr << "syncmer " << s << ' ' << *args.syncmer_arg << std::endl;
-            syncmer_data.reset(new syncmer_data_type(s, *args.syncmer_arg, &prg));
-            lookups.emplace_back(std::bind_front(syncmer, syncmer_data.get()));
+            const syncmer_scheme scheme(s, *args.syncmer_arg, &prg);
+            return sketch_strand(args, scheme);
 		} else {
             std::cerr << "syncmer large" << s << ' ' << *args.syncmer_arg << std::endl;
-			syncmer_large_data.reset(new syncmer_large_data_type(s, *args.syncmer_arg, &prg));
-			lookups.emplace_back(std::bind_front(syncmer_large, syncmer_large_data.get()));
+			const syncmer_large_scheme scheme(s, *args.syncmer_arg, &prg);
+			return sketch_strand(args, scheme);
 		}
 	} else if(args.frac_arg) {
-		frac_data.reset(new frac_data_type(*args.frac_arg, prg));
-		lookups.emplace_back(std::bind_front(frac, frac_data.get()));
+		const frac_scheme scheme(*args.frac_arg, prg);
+		return sketch_strand(args, scheme);
 	} else if(args.champarnaud_flag) {
-		champarnaud_data.reset(new champarnaud_data_type());
-		lookups.emplace_back(std::bind_front(champarnaud, champarnaud_data.get()));
-	} else {
-		std::cerr << "Missing set" << std::endl;
-		return EXIT_FAILURE;
-	}
-
-	if(args.canonical_flag) {
-	 	lookups.emplace_back(std::bind_front(canonical_fn, lookups.back()));
-	} else if(args.union_flag) {
-		lookups.emplace_back(std::bind_front(union_fn, lookups.back()));
-	}
-
-	lookups.emplace_back(std::bind_front(memoized, &mer_set_cache, lookups.back()));
-
-	const auto& lookup = lookups.back();
-	std::vector<size_t> histo;
-	translated_stream ts(args.alphabet_arg ? *args.alphabet_arg : nullptr, mer_ops::alpha, std::cin);
-
-	while(ts) {
-		// std::cout << "loop" << std::endl;
-		const auto density = fill_in_histo(ts, histo, lookup);
-		if(!ts.seq_name().empty())
-			std::cout << '>' << ts.seq_name() << '\n';
-		std::cout << "# density " << density << '\n';
-		if(args.sum_flag) {
-			size_t sum = 0;
-			for(size_t i = 0; i < histo.size(); ++i) {
-				if(histo[i] && i >= args.hmin_arg)
-					sum += i * histo[i];
-			}
-			std::cout << sum << '\n';
-		} else {
-			for(size_t i = 0; i < histo.size(); ++i) {
-				if(histo[i] && i >= args.hmin_arg)
-					std::cout << i << ' ' << histo[i] << '\n';
-			}
-		}
+		const champarnaud_scheme scheme;
+		return sketch_strand(args, scheme);
 	}
 
-	if(!ts.is.eof()) {
-		std::cerr << "Encountered error reading sequence" << std::endl;
-		return EXIT_FAILURE;
-	}
-
-	return EXIT_SUCCESS;
+	std::cerr << "Missing set" << std::endl;
+	return EXIT_FAILURE;
 }
@@ -2,6 +2,8 @@
 #define SYNCMER_H_
 
 #include<vector>
+#include <bit>
+#include <cstddef>
 #include "divisor.hpp"
 #include "permutations.hpp"
 
@@ -37,4 +39,128 @@ unsigned min_large_smer(mer_t m, unsigned s, const LubyRackofPermutation<mer_t>&
 	return mer_ops::k - s - min;
 }
 
+// Order on s-mers given by an explicit table (small s)
+template<typename mer_t>
+struct smer_table_order {
+	const std::vector<mer_t>& order;
+	smer_table_order(const std::vector<mer_t>& o) : order(o) {}
+	inline mer_t operator()(mer_t smer) const { return order[smer]; }
+};
+
+// Order on s-mers given by a permutation (large s)
+template<typename mer_t>
+struct smer_perm_order {
+	const LubyRackofPermutation<mer_t>& perm;
+	smer_perm_order(const LubyRackofPermutation<mer_t>& p) : perm(p) {}
+	inline mer_t operator()(mer_t smer) const { return perm(smer); }
+};
+
+// Streaming syncmer detection. Fed the consecutive k-mers of a sequence (and
+// their reverse complement), it maintains the ranks of the k-s+1 s-mers of
+// the current k-mer in a monotone deque, so that the position of the minimum
+// s-mer is found in amortized O(1) per base instead of rescanning the
+// k-mer. Gives the same answers as min_smer / min_large_smer (the leftmost
+// minimum s-mer wins ties).
+//
+// If track_rc is true, the minimum s-mer of the reverse complement k-mer is
+// also maintained (for the canonical and union modes). reset() must be called
+// when the k-mers are not consecutive (e.g., at the beginning of a record).
+template<typename mer_ops, typename Order, bool track_rc = false>
+struct syncmer_stream {
+	typedef typename mer_ops::mer_t mer_t;
+	static constexpr unsigned ring_bits = std::bit_width(mer_ops::k);
+	static constexpr size_t ring_size = (size_t)1 << ring_bits; // > k >= number of s-mers in a k-mer
+
+	const Order order;
+	const unsigned s;
+	const unsigned nb_smers; // Number of s-mers in a k-mer
+	static constexpr bool fast_div = sizeof(mer_t) <= sizeof(uint64_t);
+	const mer_t pow_s, pow_ks; // alpha^s and alpha^(k-s)
+	const jflib::divisor64 div_s, div_ks; // Same, fast division. Only if fast_div.
+
+	syncmer_stream(const Order& o, unsigned s)
+		: order(o)
+		, s(s)
+		, nb_smers(mer_ops::k - s + 1)
+		, pow_s(ipow((mer_t)mer_ops::alpha, s))
+		, pow_ks(ipow((mer_t)mer_ops::alpha, mer_ops::k - s))
+		, div_s(fast_div ? (uint64_t)pow_s : 1)
+		, div_ks(fast_div ? (uint64_t)pow_ks : 1)
+		{ reset(); }
+
+	void reset() {
+		m_fwd.clear();
+		m_rc.clear();
+		m_pos = 0;
+	}
+
+	// Add the next k-mer m (with reverse complement rc) of the sequence.
+	void push(mer_t m, mer_t rc) {
+		if(m_pos == 0) [[unlikely]] {
+			// First k-mer: push all its s-mers, left to right.
+			for(unsigned p = 0; p < nb_smers; ++p) {
+				push_smer((m / ipow((mer_t)mer_ops::alpha, nb_smers - 1 - p)) % pow_s,
+						  (rc / ipow((mer_t)mer_ops::alpha, p)) % pow_s);
+			}
+		} else if constexpr (fast_div) {
+			push_smer(m % div_s, rc / div_ks);
+		} else {
+			push_smer(m % pow_s, rc / pow_ks);
+		}
+		// Drop s-mers that are not in the current k-mer anymore
+		const size_t start = m_pos - nb_smers;
+		while(m_fwd.front().pos < start) m_fwd.pop_front();
+		if constexpr (track_rc) {
+			while(m_rc.front().pos < start) m_rc.pop_front();
+		}
+	}
+
+	// Position (from the left) of the minimum s-mer in the current k-mer
+	inline unsigned min_smer() const { return m_fwd.front().pos - (m_pos - nb_smers); }
+
+	// Position (from the left) of the minimum s-mer in the reverse complement
+	// of the current k-mer.
+	inline unsigned min_rc_smer() const {
+		static_assert(track_rc, "Reverse complement not tracked");
+		return (m_pos - 1) - m_rc.front().pos;
+	}
+
+protected:
+	struct elt {
+		size_t pos; // Position of the s-mer in the sequence
+		mer_t  rank;
+	};
+
+	// Fixed size deque, no allocation.
+	struct ring {
+		elt    elts[ring_size];
+		size_t head = 0, tail = 0;
+		void clear() { head = tail = 0; }
+		bool empty() const { return head == tail; }
+		const elt& front() const { return elts[head % ring_size]; }
+		const elt& back() const { return elts[(tail - 1) % ring_size]; }
+		void pop_front() { ++head; }
+		void pop_back() { --tail; }
+		void push_back(const elt& e) { elts[tail++ % ring_size] = e; }
+	};
+
+	ring   m_fwd, m_rc;
+	size_t m_pos; // Number of s-mers pushed
+
+	void push_smer(mer_t smer, mer_t rc_smer) {
+		// Forward: leftmost minimum wins ties, keep older equal ranks.
+		const mer_t r = order(smer);
+		while(!m_fwd.empty() && m_fwd.back().rank > r) m_fwd.pop_back();
+		m_fwd.push_back(elt{m_pos, r});
+		if constexpr (track_rc) {
+			// Reverse complement: the rightmost s-mer in the sequence is the
+			// leftmost in the reverse complement, keep the newer equal ranks.
+			const mer_t rr = order(rc_smer);
+			while(!m_rc.empty() && m_rc.back().rank >= rr) m_rc.pop_back();
+			m_rc.push_back(elt{m_pos, rr});
+		}
+		++m_pos;
+	}
+};
+
 #endif // SYNCMER_H_
@@ -44,7 +44,6 @@ int main(int argc, char* argv[]) {
 	}
 	// const unsigned nb_s_mers = mer_ops::k - args.s_arg + 1;
 	const auto nb_smers = ipow(mer_ops::alpha, args.s_arg);
-	jflib::divisor64 div_s(nb_smers); // Fast division / modulo by nb_smers
 
 	// The properly seeded PRG
 	auto prg = seeded_prg<std::mt19937_64>(args.oseed_arg ? *args.oseed_arg : nullptr,
@@ -57,22 +56,27 @@ int main(int argc, char* argv[]) {
 		std::shuffle(smer_order.begin(), smer_order.end(), prg);
 
 	char inchar = '0';
-	mer_t mer = 0;
+	mer_t mer = 0, rc_mer = 0;
 	size_t offset = 0;
 	translated_stream ts(*args.alphabet_arg, mer_ops::k, std::cin);
 	// Read first k-1 bases
 	while(offset + 1 < mer_ops::k && ts >> inchar) {
 		mer = mer_ops::nmer(mer, inchar);
+		rc_mer = mer_ops::pmer(rc_mer, mer_ops::alpha - 1 - inchar);
 		// std::cout << "s-mer " << (size_t)inchar << ' ' << (size_t)mer << '\n';
 		++offset;
 	}
 
+	// Position of the minimum s-mer maintained while streaming
+	syncmer_stream<mer_ops, smer_table_order<mer_t>, true> stream(smer_table_order<mer_t>(smer_order), args.s_arg);
 	std::vector<size_t> histo;
 	size_t prev = 0;
 	offset = 0;
 	while(ts >> inchar) {
 		mer = mer_ops::nmer(mer, inchar);
-		const unsigned min = min_smer<mer_ops>(args.canonical_flag ? mer_ops::canonical(mer) : mer, args.s_arg, smer_order, div_s);
+		rc_mer = mer_ops::pmer(rc_mer, mer_ops::alpha - 1 - inchar);
+		stream.push(mer, rc_mer);
+		const unsigned min = (args.canonical_flag && rc_mer < mer) ? stream.min_rc_smer() : stream.min_smer();
 		if(min == args.t_arg) {
 			// std::cout << (size_t)mer << ' ' << offset << ' ' << prev << '\n';
 			const size_t dist = offset - prev;
@@ -3,22 +3,54 @@
 
 #include <vector>
 #include <utility>
+#include <tuple>
+#include <algorithm>
+#include <cstdint>
 
+#include "mer_op.hpp"
+
+// Number of bits to encode x
+template<typename T>
+constexpr unsigned bit_length(T x) {
+	unsigned res = 0;
+	for( ; x > 0; x >>= 1)
+		++res;
+	return res;
+}
+
+// Memory lean Tarjan algorithm (Pearce's variant): a single rank array
+// (rindex) replaces index and lowlink. The DFS index of a node is kept on the
+// call stack only, and a node is the root of an SCC if its rank was not
+// lowered. rindex is stored in the smallest integer type large enough for
+// nb_mers - 1 (uint32_t rather than uint64_t for k = 16 on DNA). The onstack
+// information is given by two bit vectors: visited, and removed.
+//
+// Before the DFS, the nodes in the set and the nodes which can not be on a
+// cycle (no successor or no predecessor outside of the removed nodes,
+// iteratively) are removed. The DFS never visits them. The nodes are also
+// removed once their SCC is found.
 template<typename mer_ops>
 struct tarjan_scc {
 	typedef typename mer_ops::mer_t mer_t;
-	static constexpr mer_t undefined = mer_ops::nb_mers;
+	typedef typename optimal_int<std::max(1u, bit_length(mer_ops::nb_mers - 1)), uint8_t, uint16_t, uint32_t, uint64_t, __uint128_t>::type rank_t;
+
+	struct call_type {
+		mer_t    m;
+		rank_t   index; // DFS index of m. m is a root if rindex[m] is still index
+		unsigned b;     // Next edge to explore
+	};
+
+	std::vector<rank_t> rindex;
+	std::vector<bool> visited, removed;
 	std::vector<mer_t> stack;
-	mer_t current, scc_index;
-	std::vector<mer_t> index;
-	std::vector<mer_t> lowlink;
-	std::vector<bool> onstack;
-	std::vector<std::pair<mer_t,unsigned>> callstack; // To linearize algorithm
+	std::vector<call_type> callstack; // To linearize algorithm
+	rank_t current;
+	mer_t scc_index;
 
 	tarjan_scc()
-	: index(mer_ops::nb_mers, undefined)
-	, lowlink(mer_ops::nb_mers, undefined)
-	, onstack(mer_ops::nb_mers, false)
+	: rindex(mer_ops::nb_mers, 0)
+	, visited(mer_ops::nb_mers, false)
+	, removed(mer_ops::nb_mers, false)
 		{}
 
 	static void noprogress(mer_t m) { }
@@ -29,17 +61,16 @@ struct tarjan_scc {
 	// component.
 	template<typename Fn, typename E1, typename E2, typename E3>
 	void scc_iterate(Fn fn, E1 new_scc, E2 new_node, E3 new_visit = noprogress) {
-		std::fill(index.begin(), index.end(), undefined);
-		std::fill(lowlink.begin(), lowlink.end(), undefined);
-		std::fill(onstack.begin(), onstack.end(), false);
+		std::fill(visited.begin(), visited.end(), false);
+		prune(fn);
 
 		current = 0;
 		scc_index= 0;
 		stack.clear();
 
 		for(mer_t m = 0; m < mer_ops::nb_mers; ++m) {
-			if(index[m] == undefined && !fn(m))
-				strong_connect(fn, m, new_scc, new_node, new_visit);
+			if(!visited[m] && !removed[m])
+				strong_connect(m, new_scc, new_node, new_visit);
 		}
 	}
 
@@ -75,64 +106,96 @@ struct tarjan_scc {
 	}
 
 private:
+	// Is m a dead end: no successor or no predecessor left
+	inline bool dead_end(mer_t m) const {
+		bool has_succ = false, has_pred = false;
+		for(unsigned b = 0; b < mer_ops::alpha; ++b) {
+			has_succ = has_succ || !removed[mer_ops::nmer(m, b)];
+			has_pred = has_pred || !removed[mer_ops::pmer(m, b)];
+		}
+		return !has_succ || !has_pred;
+	}
+
+	// Mark the nodes in the set and the nodes not on a cycle. When a node is
+	// removed, its neighbors are checked again.
+	template<typename Fn>
+	void prune(Fn fn) {
+		for(mer_t m = 0; m < mer_ops::nb_mers; ++m)
+			removed[m] = fn(m);
+
+		for(mer_t m = 0; m < mer_ops::nb_mers; ++m) {
+			if(removed[m] || !dead_end(m)) continue;
+			removed[m] = true;
+			stack.push_back(m);
+			while(!stack.empty()) {
+				const mer_t u = stack.back();
+				stack.pop_back();
+				for(unsigned b = 0; b < mer_ops::alpha; ++b) {
+					for(const mer_t n : { mer_ops::nmer(u, b), mer_ops::pmer(u, b) }) {
+						if(!removed[n] && dead_end(n)) {
+							removed[n] = true;
+							stack.push_back(n);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	inline void visit(mer_t m) {
+		rindex[m] = current;
+		visited[m] = true;
+		callstack.push_back({m, current, 0});
+		++current;
+	}
+
 	// Non-recursive implementation of Tarjan algorithm to find SCCs. Calls
 	// new_scc upon finding a new SCC, and then calls new_node for each node in
 	// that SCC.
-	template<typename Fn, typename E1, typename E2, typename E3>
-	inline void strong_connect(Fn fn, mer_t m, E1 new_scc, E2 new_node, E3 new_visit) {
+	template<typename E1, typename E2, typename E3>
+	inline void strong_connect(mer_t m, E1 new_scc, E2 new_node, E3 new_visit) {
 		new_visit(m);
-		index[m] = current;
-		lowlink[m] = current;
-		++current;
-		stack.push_back(m);
-		onstack[m] = true;
-		callstack.emplace_back(m, 0);
+		visit(m);
 
-		unsigned b;
 		while(!callstack.empty()) {
-			std::tie(m, b) = callstack.back();
-			if(b < mer_ops::alpha) {
+			auto& top = callstack.back();
+			m = top.m;
+			if(top.b < mer_ops::alpha) {
 				// Still edges to explore
-				++callstack.back().second;
-				const mer_t nmer = mer_ops::nmer(m, b);
-				if(fn(nmer)) continue;
+				const mer_t nmer = mer_ops::nmer(m, top.b++);
+				if(removed[nmer]) continue;
 
-				if(index[nmer] == undefined) {
+				if(!visited[nmer]) {
 					// Explore neighbor: push stack
 					new_visit(m);
-					index[nmer] = current;
-					lowlink[nmer] = current;
-					++current;
-					stack.push_back(nmer);
-					onstack[nmer] = true;
-					callstack.emplace_back(nmer, 0);
-				} else if(onstack[nmer]) {
-					lowlink[m] = std::min(lowlink[m], index[nmer]);
+					visit(nmer);
+				} else if(rindex[nmer] < rindex[m]) {
+					rindex[m] = rindex[nmer];
 				}
-			} else {
-				if(lowlink[m] == index[m]) {
-					// A single node is not an SCC, unless has a self loop (homopolymers)
-					if(stack.back() == m && !mer_ops::is_homopolymer(m)) {
-						onstack[m] = false;
+				continue;
+			}
+
+			const rank_t index = top.index;
+			callstack.pop_back();
+			if(rindex[m] == index) {
+				// m is a root. Pop its component from the stack. A single node
+				// is not an SCC, unless has a self loop (homopolymers)
+				const bool alone = stack.empty() || rindex[stack.back()] < index;
+				if(!alone || mer_ops::is_homopolymer(m)) {
+					new_scc(scc_index++);
+					while(!stack.empty() && rindex[stack.back()] >= index) {
+						const auto mm = stack.back();
 						stack.pop_back();
-					} else {
-						new_scc(scc_index++);
-						while(true) {
-							const auto mm = stack.back();
-							stack.pop_back();
-							onstack[mm] = false;
-							new_node(mm);
-							if(mm == m) break;
-						}
+						removed[mm] = true;
+						new_node(mm);
 					}
+					new_node(m);
 				}
-				// Pop callstack
-				callstack.pop_back();
-				if(!callstack.empty()) {
-					std::tie(m, b) = callstack.back();
-					mer_t nmer = mer_ops::nmer(m, b-1); // Value of nmer when pushed to callstack
-					lowlink[m] = std::min(lowlink[m], lowlink[nmer]);
-				}
+				removed[m] = true;
+			} else {
+				stack.push_back(m);
+				const mer_t parent = callstack.back().m; // Not a root, has a parent
+				rindex[parent] = std::min(rindex[parent], rindex[m]);
 			}
 		}
 	}
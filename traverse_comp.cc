@@ -4,6 +4,17 @@
 #include <mutex>
 #include <vector>
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <sstream>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_set>
+#include <filesystem>
+#include <fstream>
+#include <csignal>
+#include <optional>
+#include <unistd.h>
 
 #ifndef K
     #error Must define k-mer length K
@@ -18,6 +29,9 @@
 #include "imoves.hpp"
 #include "imove_signature.hpp"
 #include "file_queue.hpp"
+#include "ws_deque.hpp"
+#include "external_sort.hpp"
+#include "simple_thread_pool.hpp"
 #include "misc.hpp"
 #include "backtrace.hpp"
 
@@ -31,10 +45,15 @@ typedef mer_ops::mer_t mer_t;
 typedef std::lock_guard<std::mutex> guard_t;
 
 struct TraverseCompArgs : argparse::Args {
-    std::string& comps_arg = kwarg("c,comps", "Output file for component");
+    std::string& comps_arg = kwarg("c,comps", "Output file for component (binary, see comps2text)");
     std::string& dot_arg = kwarg("d,dot", "Output file for the component graph");
     bool& progress_flag = flag("p,progress", "Display progress");
     uint32_t& threads_arg = kwarg("t,threads", "Thread target (all)").set_default(0);
+    bool& fingerprint_flag = flag("f,fingerprint", "Store 128-bit fingerprints of the signatures (less memory, not exact)");
+    uint32_t& checkpoint_arg = kwarg("checkpoint", "Checkpoint interval in seconds (0: never)").set_default(0);
+    bool& resume_flag = flag("resume", "Resume from the last checkpoint");
+    std::optional<const char*>& external_arg = kwarg("x,external", "Out-of-core traversal, with temporary files in this directory");
+    uint32_t& memory_arg = kwarg("m,memory", "Memory budget (MB) for out-of-core traversal").set_default(1024);
     std::vector<const char*>& comp_arg = arg("component").set_default("");
 
     void welcome() {
@@ -45,81 +64,272 @@ struct TraverseCompArgs : argparse::Args {
     }
 };
 
-void thread_work(comp_queue<mer_ops>& queue, std::mutex& qlock,
-                 signatures_type<mer_ops>& signatures, std::mutex& sig_lock,
-                 std::ostream& dot_fd, std::mutex& dot_lock) {
-    queue_elt<mer_ops> current, nelt;
-    mds_op_type<mer_ops> mds_op;
-    imoves_type<mer_ops> imoves_op;
-    std::pair<signatures_type<mer_ops>::iterator, bool> ires;
-    bool empty = false;
-    int retries = 0;
+typedef queue_elt<mer_ops> elt_t;
 
-    nelt.fms.resize(mer_ops::nb_mers);
+// Checkpoint of a traversal: lengths of the component and dot files, and
+// indices of the components found but not yet explored. The signatures are
+// not saved: they are in the component file. The checkpoint file is text, next
+// to the component file, and replaced atomically.
+struct checkpoint_type {
+    std::streamoff comps_length = 0, dot_length = 0;
+    std::vector<size_t> pending;
 
-    while(true) {
+    static std::string path(const std::string& comps) { return comps + ".checkpoint"; }
+
+    bool read(const std::string& path) {
+        std::ifstream is(path);
+        size_t nb_pending = 0;
+        is >> comps_length >> dot_length >> nb_pending;
+        if(!is) return false;
+        // Every index takes at least 2 characters (digit and separator)
+        std::error_code ec;
+        const auto file_size = std::filesystem::file_size(path, ec);
+        if(ec || nb_pending > file_size / 2) return false;
+        pending.resize(nb_pending);
+        for(auto& index : pending)
+            is >> index;
+        return !is.fail();
+    }
+
+    bool write(const std::string& path) const {
+        const std::string tmp = path + ".tmp";
+        {
+            std::ofstream os(tmp);
+            os << comps_length << ' ' << dot_length << ' ' << pending.size() << '\n'
+               << join(pending, ' ') << '\n';
+            if(!os.good()) return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        return !ec;
+    }
+};
+
+// Set by SIGTERM and SIGINT: checkpoint and stop
+volatile std::sig_atomic_t stop_signal = 0;
+extern "C" void handle_stop_signal(int) { stop_signal = 1; }
+
+// State shared by the worker threads. Each worker owns a work-stealing deque
+// of components to explore, and steals from the other deques when its own is
+// empty. All the components are written to the component file. Those which do
+// not fit in a deque are read back from that file: their offsets are in
+// spilled.
+//
+// Signatures is the set of signatures found: sharded_signatures_type (exact)
+// or fingerprint_signatures_type.
+template<typename Signatures>
+struct traversal_type {
+    comp_queue<mer_ops>& queue;
+    std::mutex qlock; // Protects queue and spilled
+    struct spilled_type {
+        std::streampos pos;
+        size_t         index;
+    };
+    std::deque<spilled_type> spilled;
+    Signatures signatures;
+    std::ostream& dot_fd;
+    std::mutex dot_lock;
+    std::vector<std::unique_ptr<ws_deque<elt_t>>> deques;
+    std::atomic<size_t> pending; // Components found but not yet explored
+
+    // For checkpoints: when pause_requested is set, the workers wait between
+    // two components, with all their output flushed. running is the number
+    // of workers not yet done.
+    std::mutex pause_lock;
+    std::condition_variable pause_cond;
+    std::atomic<bool> pause_requested;
+    bool stop;
+    size_t running, paused;
+
+    static constexpr unsigned log_deque_size = 8;
+    static constexpr size_t dot_buffer_size = (size_t)1 << 16;
+
+    traversal_type(comp_queue<mer_ops>& q, std::ostream& dot, size_t threads)
+        : queue(q)
+        , dot_fd(dot)
+        , pending(0)
+        , pause_requested(false)
+        , stop(false)
+        , running(threads)
+        , paused(0)
+    {
+        for(size_t i = 0; i < threads; ++i)
+            deques.emplace_back(new ws_deque<elt_t>(log_deque_size));
+    }
+
+    // Record a new component. Write it to the component file and make it
+    // available to the workers: in the deque of thread th if it fits.
+    void enqueue(std::unique_ptr<elt_t>& elt, size_t th) {
+        ++pending;
+        bool in_deque;
         {
             guard_t guard(qlock);
-            empty = queue.empty();
-            if(!empty && !queue.dequeue(current))
-                throw std::runtime_error("Failed to dequeue element");
+            const auto pos = queue.tell();
+            if(!queue.enqueue(*elt))
+                throw std::runtime_error("Failed to enqueue element");
+            in_deque = th < deques.size() && deques[th]->push(elt.get());
+            if(!in_deque)
+                spilled.push_back({pos, elt->index});
+        }
+        if(in_deque)
+            elt.release();
+    }
+
+    // Next component to explore for thread th. Returns false if no work is
+    // available at this time (but other threads may still produce some).
+    bool get_work(size_t th, std::unique_ptr<elt_t>& elt) {
+        elt_t* ptr = deques[th]->pop();
+        for(size_t i = 1; !ptr && i < deques.size(); ++i)
+            ptr = deques[(th + i) % deques.size()]->steal();
+        if(ptr) {
+            elt.reset(ptr);
+            return true;
+        }
+
+        guard_t guard(qlock);
+        if(spilled.empty()) return false;
+        if(!elt) elt.reset(new elt_t);
+        const auto pos = spilled.front().pos;
+        spilled.pop_front();
+        if(!queue.dequeue_at(pos, *elt))
+            throw std::runtime_error("Failed to dequeue element");
+        return true;
+    }
+
+    void flush_dot(std::ostringstream& buffer) {
+        guard_t guard(dot_lock);
+        dot_fd << buffer.str();
+        buffer.str("");
+    }
+
+    // Called by a worker when pause_requested is set. Returns false if the
+    // worker must stop.
+    bool park() {
+        std::unique_lock<std::mutex> lock(pause_lock);
+        ++paused;
+        pause_cond.notify_all();
+        pause_cond.wait(lock, [this]() { return !pause_requested; });
+        --paused;
+        return !stop;
+    }
+
+    // Called by a worker when it is done
+    void leave() {
+        guard_t guard(pause_lock);
+        --running;
+        pause_cond.notify_all();
+    }
+
+    // Wait for all the workers to be paused, call fn, then resume the
+    // workers, or make them stop if stop_after is true.
+    template<typename F>
+    void paused_call(F fn, bool stop_after) {
+        std::unique_lock<std::mutex> lock(pause_lock);
+        pause_requested = true;
+        pause_cond.wait(lock, [this]() { return paused == running; });
+        fn();
+        stop = stop_after;
+        pause_requested = false;
+        pause_cond.notify_all();
+    }
+
+    // State of the traversal. Only valid when the workers are paused.
+    checkpoint_type checkpoint() {
+        checkpoint_type res;
+        queue.right.flush();
+        dot_fd.flush();
+        res.comps_length = queue.tell();
+        res.dot_length = dot_fd.tellp();
+        for(const auto& deque : deques)
+            deque->for_each([&](const elt_t* elt) { res.pending.push_back(elt->index); });
+        for(const auto& s : spilled)
+            res.pending.push_back(s.index);
+        return res;
+    }
+
+    // Reload the signatures and the pending components from the component
+    // file, before starting the workers.
+    void resume(const char* comps_path, const checkpoint_type& ckpt) {
+        const std::unordered_set<size_t> to_explore(ckpt.pending.begin(), ckpt.pending.end());
+        comp_reader<mer_ops> reader(comps_path);
+        elt_t elt;
+        for(auto pos = reader.tell(); reader.next(elt); pos = reader.tell()) {
+            signatures.restore(elt.ims, elt.index);
+            if(to_explore.count(elt.index)) {
+                spilled.push_back({pos, elt.index});
+                ++pending;
+            }
+        }
+        if(reader.error || spilled.size() != to_explore.size())
+            throw std::runtime_error("Component file does not match the checkpoint");
+    }
+};
+
+template<typename Signatures>
+void thread_work(traversal_type<Signatures>& traversal, size_t th) {
+    std::unique_ptr<elt_t> current, nelt;
+    mds_op_type<mer_ops> mds_op;
+    imoves_type<mer_ops> imoves_op;
+    std::ostringstream dot_buffer;
+    unsigned idle = 0;
+
+    while(true) {
+        if(traversal.pause_requested) {
+            traversal.flush_dot(dot_buffer);
+            if(!traversal.park()) break;
         }
-        if(empty) {
-            if(retries > 1) break;
-            ++retries;
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+        if(!traversal.get_work(th, current)) {
+            // Done when no component is left to explore, neither in the
+            // deques nor being explored by another thread.
+            if(traversal.pending == 0) break;
+            if(++idle < 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
             continue;
-        } else {
-            retries = 0;
         }
-        // std::cout << "current " << current << std::endl;
-        mds_op.fromFmoves(current.fms);
+        idle = 0;
 
-        for(const auto im : current.ims) {
+        // std::cout << "current " << *current << std::endl;
+        mds_op.fromFmoves(current->fms);
+
+        for(const auto im : current->ims) {
             // std::cout << "i-move " << im << std::endl;
             mds_op.traverse_imove(im);
             // assert2(pcr_info.check_bmds(mds_op.nbmds), "Invalid bmds after traversing I-move");
-            imoves_op.imoves(mds_op.nbmds, nelt.ims);
-            // std::cout << "nfmoves " << mds_op.nfmoves << " imoves " << nelt.ims << std::endl;
-            nelt.fms.swap(mds_op.nfmoves);
-            {
-                guard_t guard(sig_lock);
-                ires = signatures.insert(std::make_pair(nelt.ims, signatures.size()));
-            }
-
-            // std::cout << "insert " << ires.second << ' ' << ires.first->second << " | " << ires.first->first << std::endl;
-            // std::cout << "signatures " << signatures << std::endl;
-            nelt.index = ires.first->second;
+            if(!nelt) nelt.reset(new elt_t);
+            imoves_op.imoves(mds_op.nbmds, nelt->ims);
+            // std::cout << "nfmoves " << mds_op.nfmoves << " imoves " << nelt->ims << std::endl;
+            const auto ires = traversal.signatures.insert(nelt->ims);
+            nelt->index = ires.first;
 
             // Output dot graph
-            // if(current.index < nelt.index) {
-            {
-                guard_t guard(dot_lock);
-                dot_fd << "  n" << current.index
-                       << " -> n" << nelt.index
+            dot_buffer << "  n" << current->index
+                       << " -> n" << nelt->index
                        << " [label=\"" << im << "\"];\n";
-            }
-            // }
 
             if(!ires.second) continue;
-            {
-                guard_t guard(qlock);
-                queue.enqueue(nelt);
-            }
+            nelt->fms.swap(mds_op.nfmoves);
+            traversal.enqueue(nelt, th);
         }
+        if(!nelt) nelt.swap(current);
+        --traversal.pending;
+
+        if((size_t)dot_buffer.tellp() >= traversal.dot_buffer_size)
+            traversal.flush_dot(dot_buffer);
     }
+    traversal.flush_dot(dot_buffer);
+    traversal.leave();
 }
 
+template<typename Signatures>
 void progress_thread(const size_t th_target, std::atomic<size_t>& joined,
-                     signatures_type<mer_ops>& signatures, std::mutex& sig_lock) {
+                     const traversal_type<Signatures>& traversal) {
     size_t size, psize = 0;
     using namespace std::chrono;
     const auto start(system_clock::now());
     while(joined < th_target) {
-        {
-            guard_t guard(sig_lock);
-            size = signatures.size();
-        }
+        size = traversal.signatures.size();
         const auto now(system_clock::now());
         const auto diff = size - psize;
         const auto dur = now - start;
@@ -133,61 +343,336 @@ void progress_thread(const size_t th_target, std::atomic<size_t>& joined,
     }
 }
 
-int main(int argc, char* argv[]) {
-    std::ios::sync_with_stdio(false);
-    const auto args = argparse::parse<TraverseCompArgs>(argc, argv);
-
-    std::ofstream dot_fd(args.dot_arg);
-    if(!dot_fd.good()) {
-        std::cerr << "Failed to open " << args.dot_arg << std::endl;
-        return EXIT_FAILURE;
+// Checkpoint every interval seconds. On SIGTERM or SIGINT, checkpoint and
+// stop the workers.
+template<typename Signatures>
+void checkpoint_thread(traversal_type<Signatures>& traversal, const std::string& path,
+                       const uint32_t interval, const std::atomic<bool>& done) {
+    using namespace std::chrono;
+    auto last = steady_clock::now();
+    while(!done) {
+        std::this_thread::sleep_for(milliseconds(100));
+        const bool interrupted = stop_signal;
+        if(!interrupted && steady_clock::now() - last < seconds(interval)) continue;
+        traversal.paused_call([&]() {
+            if(!traversal.checkpoint().write(path))
+                std::cerr << "Failed to write checkpoint " << path << std::endl;
+        }, interrupted);
+        if(interrupted) break;
+        last = steady_clock::now();
     }
-    dot_fd << "digraph {\n";
-    comp_queue<mer_ops> queue(args.comps_arg.c_str());
-    signatures_type<mer_ops> signatures;
+}
 
-    { // Initialize signature set and queue
-        imoves_type<mer_ops> imoves_op;
+// Returns false if the traversal was interrupted
+template<typename Signatures>
+bool traverse(const TraverseCompArgs& args, comp_queue<mer_ops>& queue, std::ostream& dot_fd,
+              const checkpoint_type& ckpt) {
+    size_t th_target = args.threads_arg;
+    if(th_target == 0) th_target = std::thread::hardware_concurrency();
+    traversal_type<Signatures> traversal(queue, dot_fd, th_target);
+
+    if(args.resume_flag) {
+        traversal.resume(args.comps_arg.c_str(), ckpt);
+    } else { // Initialize signature set and queue
+        parallel_imoves_type<mer_ops> imoves_op(th_target);
         mds_op_type<mer_ops> mds_op;
-        queue_elt<mer_ops> current;
+        std::unique_ptr<elt_t> current(new elt_t);
 #ifndef NDEBUG
         pcr_info_type<mer_ops> pcr_info;
 #endif
 
         const auto start(mds_from_arg<mer_t>(args.comp_arg));
         assert2(pcr_info.check_mds(start), "Invalid starting MDS");
-        current.index = 0;
-        current.ims = imoves_op.imoves(start);
-        signatures.insert(std::make_pair(current.ims, current.index));
+        current->ims = imoves_op.imoves(start);
+        current->index = traversal.signatures.insert(current->ims).first;
 
         mds_op.mds2fmoves(start);
-        current.fms = mds_op.fmoves;
-        queue.enqueue(current);
+        current->fms = mds_op.fmoves;
+        traversal.enqueue(current, 0);
     }
 
-    std::mutex qlock, sig_lock, dot_lock;
-    size_t th_target = args.threads_arg;
-    if(th_target == 0) th_target = std::thread::hardware_concurrency();
     std::vector<std::thread> threads;
-    for(size_t i = 0; i < th_target; ++i) {
-        threads.emplace_back(thread_work,
-                             std::ref(queue), std::ref(qlock),
-                             std::ref(signatures), std::ref(sig_lock),
-                             std::ref(dot_fd), std::ref(dot_lock));
-    }
+    for(size_t i = 0; i < th_target; ++i)
+        threads.emplace_back(thread_work<Signatures>, std::ref(traversal), i);
 
     std::atomic<size_t> joined(0);
     if(args.progress_flag)
-        threads.emplace_back(progress_thread,
+        threads.emplace_back(progress_thread<Signatures>,
                              th_target, std::ref(joined),
-                             std::ref(signatures), std::ref(sig_lock));
+                             std::cref(traversal));
+
+    std::atomic<bool> done(false);
+    std::thread checkpointer;
+    if(args.checkpoint_arg > 0) {
+        std::signal(SIGTERM, handle_stop_signal);
+        std::signal(SIGINT, handle_stop_signal);
+        checkpointer = std::thread(checkpoint_thread<Signatures>, std::ref(traversal),
+                                   checkpoint_type::path(args.comps_arg), args.checkpoint_arg,
+                                   std::cref(done));
+    }
 
     for(auto& th : threads) {
         th.join();
         ++joined;
     }
+    done = true;
+    if(checkpointer.joinable())
+        checkpointer.join();
+
+    return !traversal.stop;
+}
+
+// Out-of-core traversal (--external). Breadth first, level by level. The
+// children of the components of a level are written to sorted runs on disk,
+// then merged with the sorted file of the signatures found in the previous
+// levels. The new signatures get an index and are appended to the component
+// file, where they form the next level.
+//
+// The sort key of a signature is its 128-bit fingerprint, then the signature
+// itself: the order is total and the deduplication is exact.
+typedef imove_sig_type<mer_ops> imove_sig_t;
+
+int compare_sigs(const XXH128_hash_t& fp1, const imove_sig_t& ims1, const XXH128_hash_t& fp2, const imove_sig_t& ims2) {
+    if(fp1.high64 != fp2.high64) return fp1.high64 < fp2.high64 ? -1 : 1;
+    if(fp1.low64 != fp2.low64) return fp1.low64 < fp2.low64 ? -1 : 1;
+    const size_t len = std::min(ims1.size(), ims2.size());
+    for(size_t i = 0; i < len; ++i) {
+        if(ims1[i].fm != ims2[i].fm) return ims1[i].fm < ims2[i].fm ? -1 : 1;
+        if(ims1[i].im != ims2[i].im) return ims1[i].im < ims2[i].im ? -1 : 1;
+    }
+    return ims1.size() < ims2.size() ? -1 : (ims1.size() > ims2.size() ? 1 : 0);
+}
+
+inline void put_fp(std::string& buf, const XXH128_hash_t& fp) {
+    buf.append((const char*)&fp, sizeof(fp));
+}
+
+inline const char* get_fp(const char* ptr, const char* end, XXH128_hash_t& fp) {
+    if(ptr + sizeof(fp) > end) return nullptr;
+    memcpy(&fp, ptr, sizeof(fp));
+    return ptr + sizeof(fp);
+}
+
+// Child found while exploring a level: the component (index not set) and the
+// edge leading to it.
+struct child_type {
+    XXH128_hash_t       fp;
+    size_t              parent;
+    imove_type<mer_ops> im;
+    elt_t               elt;
+
+    bool operator<(const child_type& rhs) const { return compare_sigs(fp, elt.ims, rhs.fp, rhs.elt.ims) < 0; }
+
+    static void encode(std::string& buf, const child_type& c) {
+        put_fp(buf, c.fp);
+        record::put_varint(buf, c.parent);
+        record::put_varint(buf, c.im.fm);
+        buf.push_back((char)c.im.im);
+        encode_payload(buf, c.elt);
+    }
+
+    static bool decode(const char* ptr, const char* end, child_type& c) {
+        if(!(ptr = get_fp(ptr, end, c.fp))) return false;
+        if(!(ptr = record::get_varint(ptr, end, c.parent))) return false;
+        if(!(ptr = record::get_varint(ptr, end, c.im.fm)) || ptr >= end) return false;
+        c.im.im = *ptr++;
+        return ::decode(ptr, end, c.elt);
+    }
+};
+
+// Signature of a component already found
+struct visited_type {
+    XXH128_hash_t fp;
+    size_t        index;
+    imove_sig_t   ims;
+
+    static void encode(std::string& buf, const visited_type& v) {
+        put_fp(buf, v.fp);
+        record::put_varint(buf, v.index);
+        record::put_ims<mer_ops>(buf, v.ims);
+    }
+
+    static bool decode(const char* ptr, const char* end, visited_type& v) {
+        if(!(ptr = get_fp(ptr, end, v.fp))) return false;
+        if(!(ptr = record::get_varint(ptr, end, v.index))) return false;
+        return record::get_ims<mer_ops>(ptr, end, v.ims) == end;
+    }
+};
+
+void traverse_external(const TraverseCompArgs& args, comp_queue<mer_ops>& queue, std::ostream& dot_fd) {
+    typedef run_sorter<child_type, child_type, std::less<child_type>> sorter_type;
+    namespace fs = std::filesystem;
+
+    const fs::path tmpdir = fs::path(*args.external_arg) / ("traverse_comp." + std::to_string(getpid()));
+    fs::create_directories(tmpdir);
+    const std::string visited_path = tmpdir / "visited";
+    const std::string nvisited_path = tmpdir / "visited.new";
+
+    size_t th_target = args.threads_arg;
+    if(th_target == 0) th_target = std::thread::hardware_concurrency();
+    const size_t budget = ((size_t)args.memory_arg << 20) / th_target;
+
+    std::vector<mds_op_type<mer_ops>> mds_ops(th_target);
+    std::vector<imoves_type<mer_ops>> imoves_ops(th_target);
+    size_t nb_comps = 0, level_size = 1;
+
+    { // Level 0: the starting component
+        elt_t current;
+#ifndef NDEBUG
+        pcr_info_type<mer_ops> pcr_info;
+#endif
+        const auto start(mds_from_arg<mer_t>(args.comp_arg));
+        assert2(pcr_info.check_mds(start), "Invalid starting MDS");
+        current.index = nb_comps++;
+        current.ims = parallel_imoves_type<mer_ops>(th_target).imoves(start);
+        mds_ops[0].mds2fmoves(start);
+        current.fms = mds_ops[0].fmoves;
+        queue.enqueue(current);
+
+        record_writer<visited_type, visited_type> visited(visited_path);
+        visited.write({fingerprint_signatures_type<mer_ops>::fingerprint(current.ims), current.index, current.ims});
+        visited.close();
+    }
+
+    simple_thread_pool<std::function<void(int)>> pool(th_target);
+    std::mutex qlock;
+    for(size_t level = 0; level_size > 0; ++level) {
+        if(args.progress_flag)
+            std::cerr << '\r' << "level " << level << ' ' << level_size << ' ' << nb_comps << "\033[0k" << std::flush;
+
+        // Explore the components of the level, each thread writes its own
+        // sorted runs
+        std::vector<sorter_type> sorters;
+        for(size_t th = 0; th < th_target; ++th)
+            sorters.emplace_back(tmpdir / ("run." + std::to_string(th) + "."), budget);
+        size_t to_read = level_size;
+        pool.set_work([&](int th) {
+            auto& mds_op = mds_ops[th];
+            auto& imoves_op = imoves_ops[th];
+            elt_t current;
+            while(true) {
+                {
+                    guard_t guard(qlock);
+                    if(to_read == 0) break;
+                    --to_read;
+                    if(!queue.dequeue(current))
+                        throw std::runtime_error("Failed to dequeue element");
+                }
+                mds_op.fromFmoves(current.fms);
+                for(const auto im : current.ims) {
+                    mds_op.traverse_imove(im);
+                    child_type child{}; // elt.index is assigned at the merge, if a new component
+                    imoves_op.imoves(mds_op.nbmds, child.elt.ims);
+                    child.fp = fingerprint_signatures_type<mer_ops>::fingerprint(child.elt.ims);
+                    child.parent = current.index;
+                    child.im = im;
+                    child.elt.fms = mds_op.nfmoves;
+                    const size_t bytes = sizeof(child) + child.elt.fms.size() * sizeof(mer_t) + child.elt.ims.size() * sizeof(im);
+                    sorters[th].add(std::move(child), bytes);
+                }
+            }
+            sorters[th].finish();
+        });
+        pool.start();
+        if(to_read > 0)
+            throw std::runtime_error("Failed to explore level");
+
+        // Merge the children with the signatures of the previous levels
+        std::vector<std::string> runs;
+        for(const auto& sorter : sorters)
+            runs.insert(runs.end(), sorter.runs().begin(), sorter.runs().end());
+        run_merger<child_type, child_type, std::less<child_type>> children(runs);
+        record_reader<visited_type, visited_type> visited(visited_path);
+        record_writer<visited_type, visited_type> nvisited(nvisited_path);
+
+        level_size = 0;
+        child_type child;
+        visited_type v;
+        bool more = children.next(child);
+        bool more_v = visited.next(v);
+        imove_sig_t ims;
+        while(more) {
+            while(more_v && compare_sigs(v.fp, v.ims, child.fp, child.elt.ims) < 0) {
+                nvisited.write(v);
+                more_v = visited.next(v);
+            }
+            size_t index;
+            if(more_v && compare_sigs(v.fp, v.ims, child.fp, child.elt.ims) == 0) {
+                index = v.index;
+            } else { // New component
+                index = child.elt.index = nb_comps++;
+                ++level_size;
+                queue.enqueue(child.elt);
+                nvisited.write({child.fp, index, child.elt.ims});
+            }
+
+            // All the edges to that component
+            const XXH128_hash_t fp = child.fp;
+            ims.swap(child.elt.ims);
+            do {
+                dot_fd << "  n" << child.parent
+                       << " -> n" << index
+                       << " [label=\"" << child.im << "\"];\n";
+                more = children.next(child);
+            } while(more && compare_sigs(fp, ims, child.fp, child.elt.ims) == 0);
+        }
+        for( ; more_v; more_v = visited.next(v))
+            nvisited.write(v);
+        nvisited.close();
+        fs::rename(nvisited_path, visited_path);
+        for(auto& sorter : sorters)
+            sorter.clear();
+    }
+    pool.stop();
+    fs::remove_all(tmpdir);
+}
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    const auto args = argparse::parse<TraverseCompArgs>(argc, argv);
+
+    if(args.external_arg && (args.checkpoint_arg > 0 || args.resume_flag)) {
+        std::cerr << "Checkpoints are not supported with --external" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto ckpt_path = checkpoint_type::path(args.comps_arg);
+    checkpoint_type ckpt;
+    if(args.resume_flag) {
+        if(!ckpt.read(ckpt_path)) {
+            std::cerr << "Failed to read checkpoint " << ckpt_path << std::endl;
+            return EXIT_FAILURE;
+        }
+        // Discard what was written after the checkpoint
+        std::filesystem::resize_file(args.comps_arg, ckpt.comps_length);
+        std::filesystem::resize_file(args.dot_arg, ckpt.dot_length);
+    }
+
+    std::ofstream dot_fd(args.dot_arg, args.resume_flag ? std::ios::in | std::ios::out : std::ios::out);
+    if(!dot_fd.good()) {
+        std::cerr << "Failed to open " << args.dot_arg << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(args.resume_flag)
+        dot_fd.seekp(0, std::ios::end);
+    else
+        dot_fd << "digraph {\n";
+    comp_queue<mer_ops> queue(args.comps_arg.c_str(), args.resume_flag);
+
+    bool finished = true;
+    if(args.external_arg)
+        traverse_external(args, queue, dot_fd);
+    else if(args.fingerprint_flag)
+        finished = traverse<fingerprint_signatures_type<mer_ops>>(args, queue, dot_fd, ckpt);
+    else
+        finished = traverse<sharded_signatures_type<mer_ops>>(args, queue, dot_fd, ckpt);
+    if(!finished) {
+        std::cerr << "Interrupted. Continue with --resume" << std::endl;
+        return EXIT_FAILURE;
+    }
 
     dot_fd << "}\n";
+    std::filesystem::remove(ckpt_path);
 
     return 0;
 }
@@ -0,0 +1,111 @@
+#ifndef TRISTATE_VECTOR_H_
+#define TRISTATE_VECTOR_H_
+
+#include <algorithm>
+#include <ostream>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+
+#include "common.hpp"
+#include "dbg.hpp"
+#include "mer_set.hpp"
+
+// Tristate (nil, no or yes) of every mer, packed in 2 bit planes: the set of
+// mers which are yes and the set of mers which are no (2 bits per mer instead
+// of a byte for std::vector<tristate_t>). The yes plane is the set of mers in
+// the MDS, as a bitset, for word level operations. The 4th state, blocked, is
+// not supported.
+template<typename mer_ops>
+class tristate_vector {
+public:
+	typedef typename mer_ops::mer_t mer_t;
+	typedef mer_bitset<mer_ops> bitset_type;
+
+	// Proxy for assignment with operator[]
+	class reference {
+		tristate_vector& _v;
+		const mer_t      _m;
+	public:
+		reference(tristate_vector& v, mer_t m) : _v(v), _m(m) {}
+		operator tristate_t() const { return _v.get(_m); }
+		reference& operator=(tristate_t x) { _v.set(_m, x); return *this; }
+		reference& operator=(const reference& rhs) { return *this = (tristate_t)rhs; }
+	};
+
+	tristate_vector() = default; // All nil
+	explicit tristate_vector(tristate_t x) { fill(x); }
+
+	static constexpr size_t size() { return mer_ops::nb_mers; }
+
+	inline bool is_yes(mer_t m) const { return _yes.test(m); }
+	inline tristate_t get(mer_t m) const { return _yes.test(m) ? yes : (_no.test(m) ? no : nil); }
+	inline void set(mer_t m, tristate_t x) {
+		assert2(x != blocked, "Blocked state not supported");
+		if(x == yes) _yes.set(m); else _yes.reset(m);
+		if(x == no) _no.set(m); else _no.reset(m);
+	}
+	inline tristate_t operator[](mer_t m) const { return get(m); }
+	inline reference operator[](mer_t m) { return reference(*this, m); }
+
+	// Set of the mers which are yes
+	const bitset_type& yes_set() const { return _yes; }
+
+	void fill(tristate_t x) {
+		assert2(x != blocked, "Blocked state not supported");
+		std::fill(_yes.words.begin(), _yes.words.end(), x == yes ? ~(uint64_t)0 : 0);
+		std::fill(_no.words.begin(), _no.words.end(), x == no ? ~(uint64_t)0 : 0);
+		// Keep the bits past the end of the last word at 0
+		if(size() % 64 != 0) {
+			const uint64_t mask = ((uint64_t)1 << (size() % 64)) - 1;
+			_yes.words.back() &= mask;
+			_no.words.back() &= mask;
+		}
+	}
+
+	size_t count_yes() const { return _yes.count(); }
+	bool all_yes() const { return count_yes() == size(); }
+
+	// Call fn(m) on every mer which is yes, in increasing order
+	template<typename F>
+	void for_each_yes(F fn) const {
+		for(size_t i = 0; i < _yes.words.size(); ++i) {
+			for(uint64_t w = _yes.words[i]; w; w &= w - 1)
+				fn((mer_t)(i * 64 + std::countr_zero(w)));
+		}
+	}
+
+	bool operator==(const tristate_vector& rhs) const { return _yes.words == rhs._yes.words && _no.words == rhs._no.words; }
+	bool operator!=(const tristate_vector& rhs) const { return !(*this == rhs); }
+
+	// Same order as std::vector<tristate_t> (lexicographic)
+	bool operator<(const tristate_vector& rhs) const {
+		for(size_t i = 0; i < _yes.words.size(); ++i) {
+			const uint64_t diff = (_yes.words[i] ^ rhs._yes.words[i]) | (_no.words[i] ^ rhs._no.words[i]);
+			if(diff) {
+				const mer_t m = i * 64 + std::countr_zero(diff);
+				return get(m) < rhs.get(m);
+			}
+		}
+		return false;
+	}
+
+private:
+	bitset_type _yes, _no;
+};
+
+// Same output as for std::vector<tristate_t>: the mers which are yes.
+template<typename mer_ops>
+std::ostream& operator<<(std::ostream& os, const tristate_vector<mer_ops>& bmds) {
+	bool notfirst = false;
+	bmds.for_each_yes([&](typename mer_ops::mer_t m) {
+		if(notfirst)
+			os << ' ';
+		else
+			notfirst = true;
+		os << (uint64_t)m;
+	});
+	return os;
+}
+
+#endif // TRISTATE_VECTOR_H_
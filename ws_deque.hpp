@@ -0,0 +1,87 @@
+#ifndef WS_DEQUE_H_
+#define WS_DEQUE_H_
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free work-stealing deque (Chase-Lev, with the memory orders of Le et
+// al., "Correct and efficient work-stealing for weak memory models"). The
+// owner thread pushes and pops at the bottom, the other threads steal from
+// the top.
+//
+// The capacity is fixed: push() returns false when the deque is full, and the
+// caller must put the element somewhere else. The deque holds pointers and
+// does not own them.
+template<typename T>
+class ws_deque {
+protected:
+	const int64_t _mask;
+	std::vector<std::atomic<T*>> _buffer;
+	alignas(64) std::atomic<int64_t> _top;
+	alignas(64) std::atomic<int64_t> _bottom;
+
+public:
+	ws_deque(unsigned log_capacity)
+		: _mask(((int64_t)1 << log_capacity) - 1)
+		, _buffer((size_t)1 << log_capacity)
+		, _top(0)
+		, _bottom(0)
+		{}
+
+	// Push at the bottom. Owner only.
+	bool push(T* x) {
+		const int64_t b = _bottom.load(std::memory_order_relaxed);
+		const int64_t t = _top.load(std::memory_order_acquire);
+		if(b - t > _mask) return false; // Full
+		_buffer[b & _mask].store(x, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		_bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Pop from the bottom. Owner only. Returns nullptr if empty.
+	T* pop() {
+		const int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+		_bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = _top.load(std::memory_order_relaxed);
+		if(t > b) { // Empty
+			_bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		T* x = _buffer[b & _mask].load(std::memory_order_relaxed);
+		if(t == b) { // Last element, race with the thieves
+			if(!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				x = nullptr;
+			_bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return x;
+	}
+
+	// Steal from the top. Any thread. Returns nullptr if empty or if the
+	// element was taken by another thread.
+	T* steal() {
+		int64_t t = _top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = _bottom.load(std::memory_order_acquire);
+		if(t >= b) return nullptr;
+		T* x = _buffer[t & _mask].load(std::memory_order_relaxed);
+		if(!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return x;
+	}
+
+	// Call fn on every element, from top to bottom. Only valid when no other
+	// thread uses the deque (e.g., all the threads are paused).
+	template<typename F>
+	void for_each(F fn) const {
+		const int64_t t = _top.load(std::memory_order_relaxed);
+		const int64_t b = _bottom.load(std::memory_order_relaxed);
+		for(int64_t i = t; i < b; ++i)
+			fn(_buffer[i & _mask].load(std::memory_order_relaxed));
+	}
+};
+
+#endif // WS_DEQUE_H_